@@ -0,0 +1,74 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <crow/Actor.hpp>
+
+// Runs chains of messages through stateful actors. Each actor walks 32 KiB of
+// its own state per message, so throughput depends on that state still being
+// in the cache of the core that runs it. Compares the work stealing scheduler
+// with and without actor affinity
+
+static constexpr size_t state_size = 32 * 1024 / sizeof(size_t);
+static constexpr int chains = 64;
+static constexpr int hops = 2000;
+
+struct Work {
+    size_t key;
+    int hops;
+
+    size_t ShardKey() const { return key; }
+};
+
+static std::atomic_size_t checksum = 0;
+
+class StatefulActor : public crow::Actor<Work> {
+private:
+    std::vector<size_t> state = std::vector<size_t>(state_size, 1);
+
+public:
+    void HandleMessage(crow::MessagePtr<Work>&& msg) override {
+        size_t sum = 0;
+        for (auto& value : state) sum += value++;
+
+        if (msg->hops > 0) crow::actor_scheduler->EmplaceMessage<Work>(Work{msg->key, msg->hops - 1});
+        else checksum += sum;
+    }
+};
+
+static double Run(bool affinity) {
+    auto threads = std::max<size_t>(std::thread::hardware_concurrency(), 2);
+
+    crow::ActorSchedulerSettings settings;
+    settings.mode = crow::SchedulingMode::WorkStealing;
+    settings.actor_affinity = affinity;
+
+    crow::actor_scheduler = crow::ActorScheduler::Create(threads, settings);
+    crow::actor_scheduler->Register<StatefulActor>(chains, crow::RoutingPolicy::KeyHash);
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < chains; i++)
+        crow::actor_scheduler->EmplaceMessage<Work>(Work{static_cast<size_t>(i), hops});
+
+    crow::actor_scheduler->ProcessAllMessages();
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    crow::actor_scheduler = nullptr;
+
+    return chains * (hops + 1) / elapsed.count();
+}
+
+int main() {
+    auto without = Run(false);
+    auto with = Run(true);
+
+    std::cout << "msgs/sec without affinity: " << static_cast<size_t>(without) << "\n";
+    std::cout << "msgs/sec with affinity: " << static_cast<size_t>(with) << "\n";
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include <crow/Actor.hpp>
+
+// Asks an actor for replies, once waiting on each Future with Get and once
+// handing them to another actor with Then. Every reply object is counted, so
+// after the rounds none should be left alive. A leaked ask state would keep
+// its reply alive
+
+static constexpr int asks_per_round = 100000;
+
+static std::atomic_long live_answers = 0;
+
+struct Answer {
+    int value = 0;
+
+    explicit Answer(int value) : value{value} { live_answers++; }
+
+    Answer(const Answer& other) : value{other.value} { live_answers++; }
+
+    Answer(Answer&& other) : value{other.value} { live_answers++; }
+
+    Answer& operator=(const Answer&) = default;
+    Answer& operator=(Answer&&) = default;
+
+    ~Answer() { live_answers--; }
+};
+
+struct Question {
+    int value = 0;
+
+    crow::Promise<Answer> reply;
+};
+
+struct Answered {
+    Answer answer;
+
+    explicit Answered(Answer&& answer) : answer{std::move(answer)} {}
+};
+
+static std::atomic_int received = 0;
+
+class QuestionActor : public crow::Actor<Question> {
+public:
+    void HandleMessage(crow::MessagePtr<Question>&& msg) override { msg->reply.Set(Answer(msg->value)); }
+};
+
+class AnsweredActor : public crow::ValueActor<Answered> {
+public:
+    void HandleMessage(Answered&&) override { received++; }
+};
+
+static double RoundGet() {
+    auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < asks_per_round; i++) {
+        auto future = crow::actor_scheduler->Ask<Question, Answer>(Question{i, {}});
+        future.Get();
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    return asks_per_round / elapsed.count();
+}
+
+static double RoundThen() {
+    received = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < asks_per_round; i++)
+        crow::actor_scheduler->Ask<Question, Answer>(Question{i, {}}).Then<Answered>();
+
+    while (received < asks_per_round) crow::actor_scheduler->ProcessAllMessages();
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    return asks_per_round / elapsed.count();
+}
+
+int main() {
+    auto threads = std::max<size_t>(std::thread::hardware_concurrency(), 2);
+
+    crow::actor_scheduler = crow::ActorScheduler::Create(threads);
+    crow::actor_scheduler->Register<QuestionActor>();
+    crow::actor_scheduler->Register<AnsweredActor>();
+
+    // Warm up the pools
+    RoundGet();
+    RoundThen();
+
+    auto get = RoundGet();
+    auto then = RoundThen();
+
+    crow::actor_scheduler->ProcessAllMessages();
+
+    std::cout << "asks/sec Get: " << static_cast<size_t>(get) << "\n";
+    std::cout << "asks/sec Then: " << static_cast<size_t>(then) << "\n";
+    std::cout << "live replies: " << live_answers.load() << "\n";
+
+    crow::actor_scheduler = nullptr;
+
+    return live_answers.load() == 0 ? 0 : 1;
+}
\ No newline at end of file
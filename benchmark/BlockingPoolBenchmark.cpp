@@ -0,0 +1,76 @@
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include <crow/Actor.hpp>
+
+// Runs a chain of short compute messages while other actors sleep in their
+// handlers, as they would waiting on a file or a socket. Compares how long
+// the chain takes when those actors run on the compute threads and when they
+// run in the blocking pool
+
+static constexpr int slow_messages = 16;
+static constexpr int chain_length = 20000;
+
+struct Load {
+    int id;
+};
+
+struct Step {
+    int remaining;
+};
+
+class LoadActor : public crow::Actor<Load> {
+public:
+    crow::ExecutionClass GetExecutionClass() const override { return crow::ExecutionClass::Blocking; }
+
+    void HandleMessage(crow::MessagePtr<Load>&&) override {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+};
+
+class StepActor : public crow::Actor<Step> {
+public:
+    void HandleMessage(crow::MessagePtr<Step>&& msg) override {
+        if (msg->remaining > 0) crow::actor_scheduler->EmplaceMessage<Step>(Step{msg->remaining - 1});
+    }
+};
+
+static double Run(size_t blocking_threads) {
+    crow::ActorSchedulerSettings settings;
+    settings.blocking_threads = blocking_threads;
+
+    crow::actor_scheduler = crow::ActorScheduler::Create(4, settings);
+    crow::actor_scheduler->Register<LoadActor>(slow_messages);
+    crow::actor_scheduler->Register<StepActor>();
+
+    for (int i = 0; i < slow_messages; i++) crow::actor_scheduler->EmplaceMessage<Load>(Load{i});
+
+    auto start = std::chrono::steady_clock::now();
+
+    crow::MessageGroup chain;
+    {
+        auto scope = crow::actor_scheduler->Track(chain);
+        crow::actor_scheduler->EmplaceMessage<Step>(Step{chain_length});
+    }
+
+    crow::actor_scheduler->Wait(chain);
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    crow::actor_scheduler->ProcessAllMessages();
+    crow::actor_scheduler = nullptr;
+
+    return elapsed.count();
+}
+
+int main() {
+    auto shared = Run(0);
+    auto separate = Run(4);
+
+    std::cout << "chain ms with blocking actors on compute threads: " << shared << "\n";
+    std::cout << "chain ms with a blocking pool: " << separate << "\n";
+
+    return 0;
+}
\ No newline at end of file
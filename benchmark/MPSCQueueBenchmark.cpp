@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <crow/MPSCQueue.hpp>
+
+// Measures messages/sec through a single consumer mailbox for 1..N producers.
+// The lock free MPSCQueue is compared against a mutex + deque mailbox, so only
+// the cost of the lock is measured and not the O(n) erase the old mailbox had
+
+static constexpr size_t messages_per_producer = 200000;
+
+struct Node : public crow::MPSCQueueNode {
+    std::unique_ptr<int> msg;
+};
+
+class LockFreeMailbox {
+private:
+    crow::MPSCQueue<Node> queue;
+
+public:
+    void Push(std::unique_ptr<int>&& msg) {
+        auto node = new Node;
+        node->msg = std::move(msg);
+        queue.Push(node);
+    }
+
+    std::unique_ptr<int> Pop() {
+        auto node = queue.Pop();
+        if (!node) return nullptr;
+
+        auto msg = std::move(node->msg);
+        delete node;
+        return msg;
+    }
+};
+
+class MutexMailbox {
+private:
+    std::mutex lock;
+    std::deque<std::unique_ptr<int>> mailbox;
+
+public:
+    void Push(std::unique_ptr<int>&& msg) {
+        lock.lock();
+        mailbox.push_back(std::move(msg));
+        lock.unlock();
+    }
+
+    std::unique_ptr<int> Pop() {
+        std::unique_ptr<int> msg = nullptr;
+
+        lock.lock();
+        if (!mailbox.empty()) {
+            msg = std::move(mailbox.front());
+            mailbox.pop_front();
+        }
+        lock.unlock();
+
+        return msg;
+    }
+};
+
+template <typename Mailbox>
+double Run(size_t producers) {
+    Mailbox mailbox;
+
+    auto total = producers * messages_per_producer;
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < producers; i++) {
+        threads.emplace_back([&]() {
+            for (size_t j = 0; j < messages_per_producer; j++)
+                mailbox.Push(std::make_unique<int>(static_cast<int>(j)));
+        });
+    }
+
+    size_t received = 0;
+    while (received < total) {
+        if (mailbox.Pop()) received++;
+        else std::this_thread::yield();
+    }
+
+    for (auto& thread : threads) thread.join();
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    return total / elapsed.count();
+}
+
+int main() {
+    auto max_producers = std::max<size_t>(std::thread::hardware_concurrency(), 2) - 1;
+
+    std::cout << "producers, lock free msgs/sec, mutex msgs/sec\n";
+
+    for (size_t producers = 1; producers <= max_producers; producers++) {
+        auto lock_free = Run<LockFreeMailbox>(producers);
+        auto mutex = Run<MutexMailbox>(producers);
+
+        std::cout << producers << ", " << static_cast<size_t>(lock_free) << ", " << static_cast<size_t>(mutex) << "\n";
+    }
+
+    return 0;
+}
\ No newline at end of file
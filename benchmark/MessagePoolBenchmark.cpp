@@ -0,0 +1,92 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+#include <crow/Actor.hpp>
+#include <crow/MessagePool.hpp>
+
+// Sends messages through the ActorScheduler and counts every call to the
+// global operator new. After a warm up round the pools have all the memory
+// they need, so the measured round should make no allocations at all
+
+static std::atomic_size_t allocations = 0;
+
+// Called through pointers, so the compiler cannot see the replaced operators
+// are malloc and free underneath and warn that new is paired with free
+static void* (*volatile allocate)(std::size_t) = std::malloc;
+static void (*volatile deallocate)(void*) = std::free;
+
+void* operator new(std::size_t size) {
+    allocations++;
+
+    if (auto ptr = allocate(size == 0 ? 1 : size)) return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { deallocate(ptr); }
+
+void operator delete(void* ptr, std::size_t) noexcept { deallocate(ptr); }
+
+static constexpr int messages_per_round = 100000;
+
+struct Ping {
+    int value;
+};
+
+struct Pong {
+    int value;
+};
+
+static std::atomic_int received = 0;
+
+class PingActor : public crow::Actor<Ping> {
+public:
+    void HandleMessage(crow::MessagePtr<Ping>&& msg) override {
+        crow::actor_scheduler->EmplaceMessage<Pong>(Pong{msg->value});
+    }
+};
+
+class PongActor : public crow::Actor<Pong> {
+public:
+    void HandleMessage(crow::MessagePtr<Pong>&&) override { received++; }
+};
+
+static double Round() {
+    received = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < messages_per_round; i++)
+        crow::actor_scheduler->EmplaceMessage<Ping>(Ping{i});
+
+    while (received < messages_per_round) crow::actor_scheduler->ProcessAllMessages();
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    return messages_per_round * 2 / elapsed.count();
+}
+
+int main() {
+    crow::actor_scheduler = crow::ActorScheduler::Create(std::thread::hardware_concurrency());
+
+    crow::actor_scheduler->Register<PingActor>();
+    crow::actor_scheduler->Register<PongActor>();
+
+    Round();
+
+    auto slabs = crow::message_pool_stats.slab_allocations.load();
+    allocations = 0;
+
+    auto rate = Round();
+
+    std::cout << "msgs/sec: " << static_cast<size_t>(rate) << "\n";
+    std::cout << "operator new calls: " << allocations.load() << "\n";
+    std::cout << "new pool slabs: " << crow::message_pool_stats.slab_allocations.load() - slabs << "\n";
+    std::cout << "pool bytes: " << crow::message_pool_stats.slab_bytes.load() << "\n";
+
+    crow::actor_scheduler = nullptr;
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,81 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <crow/Actor.hpp>
+
+// Floods one actor with small messages from several threads. Compares an
+// Actor, which keeps each message in its own pooled node, with a ValueActor,
+// which keeps them by value in contiguous mailbox segments
+
+static constexpr int producers = 4;
+static constexpr int messages_per_producer = 250000;
+
+struct PointerSample {
+    int value;
+};
+
+struct ValueSample {
+    int value;
+};
+
+static std::atomic_size_t sum = 0;
+
+class PointerActor : public crow::Actor<PointerSample> {
+public:
+    void HandleMessage(crow::MessagePtr<PointerSample>&& msg) override { sum.fetch_add(msg->value, std::memory_order_relaxed); }
+};
+
+class SampleActor : public crow::ValueActor<ValueSample> {
+public:
+    void HandleMessage(ValueSample&& msg) override { sum.fetch_add(msg.value, std::memory_order_relaxed); }
+};
+
+template <typename T>
+static double Run() {
+    sum = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < producers; i++) {
+        threads.emplace_back([] {
+            for (int j = 0; j < messages_per_producer; j++) crow::actor_scheduler->EmplaceMessage<T>(T{1});
+        });
+    }
+
+    for (auto& thread : threads) thread.join();
+
+    crow::actor_scheduler->ProcessAllMessages();
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    if (sum != static_cast<size_t>(producers) * messages_per_producer) std::cout << "Lost messages\n";
+
+    return producers * messages_per_producer / elapsed.count();
+}
+
+int main() {
+    auto threads = std::max<size_t>(std::thread::hardware_concurrency(), 2);
+
+    crow::actor_scheduler = crow::ActorScheduler::Create(threads);
+    crow::actor_scheduler->Register<PointerActor>();
+    crow::actor_scheduler->Register<SampleActor>();
+
+    // Warm up the pools
+    Run<PointerSample>();
+    Run<ValueSample>();
+
+    auto pointer = Run<PointerSample>();
+    auto value = Run<ValueSample>();
+
+    crow::actor_scheduler = nullptr;
+
+    std::cout << "msgs/sec Actor: " << static_cast<size_t>(pointer) << "\n";
+    std::cout << "msgs/sec ValueActor: " << static_cast<size_t>(value) << "\n";
+
+    return 0;
+}
\ No newline at end of file
@@ -5,19 +5,23 @@
 #include <crow/Logging.hpp>
 #include <crow/Window.hpp>
 
-class IntActor : public crow::Actor<int> {
+class IntActor : public crow::ValueActor<int> {
 public:
-    void HandleMessage(std::unique_ptr<int>&& msg) override {
-        crow::app::Info("IntActor: {}", *msg);
+    void HandleMessage(int&& msg) override {
+        crow::app::Info("IntActor: {}", msg);
 
-        crow::actor_scheduler->SendMessage<float>(std::make_unique<float>(*msg));
+        crow::actor_scheduler->EmplaceMessage<float>(static_cast<float>(msg));
     }
 };
 
-class FloatActor : public crow::Actor<float> {
+class FloatActor : public crow::ValueActor<float>, public crow::Subscriber<crow::WindowResized> {
 public:
-    void HandleMessage(std::unique_ptr<float>&& msg) override {
-        crow::app::Warning("FloatActor: {}", *msg);
+    void HandleMessage(float&& msg) override {
+        crow::app::Warning("FloatActor: {}", msg);
+    }
+
+    void HandleEvent(std::shared_ptr<const crow::WindowResized> event) override {
+        crow::app::Info("FloatActor: window resized to {}x{}", std::get<0>(event->resolution), std::get<1>(event->resolution));
     }
 };
 
@@ -29,6 +33,19 @@ protected:
         //return crow::Application::GetThreadCount(); // Use all the cores!
     }
 
+    crow::ActorSchedulerSettings GetActorSchedulerSettings() const override {
+        crow::ActorSchedulerSettings settings;
+        settings.mode = crow::SchedulingMode::WorkStealing;
+        return settings;
+    }
+
+    crow::RunLoopSettings GetRunLoopSettings() const override {
+        crow::RunLoopSettings settings;
+        settings.target_fps = 60;
+        settings.fixed_timestep = 1.0 / 50.0;
+        return settings;
+    }
+
     void OnPreActorSchedulerSetup() override {
         // Setup before actor_manager is init
         crow::SetLoggingFile("log.txt");
@@ -37,21 +54,32 @@ protected:
     void OnRegisterActors() override {
         crow::actor_scheduler->Register<IntActor>();
         crow::actor_scheduler->Register<FloatActor>();
+
+        crow::actor_scheduler->Subscribe<crow::WindowResized, FloatActor>();
     }
 
     void OnPostActorSchedulerSetup() override {
         // Setup after actor_manager is init
-        crow::actor_scheduler->EmplaceMessageAs<crow::WindowMessageBase>(crow::WindowSetResolution({200, 200}));
-        crow::actor_scheduler->EmplaceMessageAs<crow::WindowMessageBase>(crow::WindowCreate{});
-        
+        crow::actor_scheduler->EmplaceMessageAs<crow::WindowMessage>(crow::WindowSetResolution({200, 200}));
+        crow::actor_scheduler->EmplaceMessageAs<crow::WindowMessage>(crow::WindowCreate{});
+
+        auto resolution = crow::actor_scheduler->Ask<crow::WindowMessage, std::tuple<int, int>>(crow::WindowGetResolution{});
+        if (auto size = resolution.Get()) {
+            crow::app::Info("Window resolution: {}x{}", std::get<0>(*size), std::get<1>(*size));
+        }
+
         crow::actor_scheduler->EmplaceMessage<float>(3.14);
         crow::actor_scheduler->EmplaceMessage<int>(1);
 
         crow::actor_scheduler->SendMessage(std::make_unique<int>(69));
     }
 
-    void OnUpdate() override {
-        crow::actor_scheduler->EmplaceMessageAs<crow::WindowMessageBase>(crow::WindowShouldClose(
+    void OnFixedUpdate(double) override {
+        // Step the simulation here
+    }
+
+    void OnUpdate(double) override {
+        crow::actor_scheduler->EmplaceMessageAs<crow::WindowMessage>(crow::WindowShouldClose(
             [&](bool close) {
                 if (close) {
                     Exit();
@@ -59,7 +87,7 @@ protected:
             }
         ));
 
-        crow::actor_scheduler->EmplaceMessageAs<crow::WindowMessageBase>(crow::WindowUpdate{});
+        crow::actor_scheduler->EmplaceMessageAs<crow::WindowMessage>(crow::WindowUpdate{});
     }
 
     void OnPreActorSchedulerCleanup() override {
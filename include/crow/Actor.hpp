@@ -1,176 +1,1777 @@
 #ifndef CROW_ACTOR_HPP
 #define CROW_ACTOR_HPP
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <concepts>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <functional>
+#include <limits>
 #include <memory>
 #include <mutex>
+#include <optional>
+#include <span>
 #include <type_traits>
 #include <typeindex>
 #include <unordered_map>
+#include <variant>
 #include <vector>
-#include <list>
 #include <thread>
 
 #include "Crow.hpp"
+#include "Future.hpp"
 #include "Logging.hpp"
+#include "MessagePool.hpp"
+#include "MPSCQueue.hpp"
+#include "SegmentedQueue.hpp"
 
 namespace crow {
 
+    /// @brief Gives every message type a small dense index, so routing a
+    /// message is an array lookup
+    class API _InternalMessageSlot {
+    private:
+        static constexpr size_t unassigned = static_cast<size_t>(-1);
+
+        /// @brief The slot of T. Each module caches its own copy
+        template <typename T>
+        static inline std::atomic_size_t cached{unassigned};
+
+        /// @brief Hands out slots. This is keyed by type so every module (exe
+        /// or shared library) agrees on the slot of a type
+        static size_t Assign(std::type_index type);
+
+    public:
+        template <typename T>
+        static size_t Get() {
+            auto slot = cached<T>.load(std::memory_order_relaxed);
+            if (slot != unassigned) return slot;
+
+            slot = Assign(std::type_index(typeid(T)));
+            cached<T>.store(slot, std::memory_order_relaxed);
+
+            return slot;
+        }
+    };
+
+    /// @brief A message that can be routed by key to one actor of a pool. All
+    /// messages with the same key go to the same instance
+    template <typename T>
+    concept ShardedMessage = requires(const T& msg) {
+        { std::hash<std::decay_t<decltype(msg.ShardKey())>>{}(msg.ShardKey()) } -> std::convertible_to<size_t>;
+    };
+
+    /// @brief A message that can replace an older one still waiting in a
+    /// coalescing mailbox. Messages with the same key are interchangeable, so
+    /// only the newest needs handling. \c std::nullopt never coalesces
+    template <typename T>
+    concept CoalescedMessage = requires(const T& msg) {
+        { msg.CoalesceKey() } -> std::convertible_to<std::optional<size_t>>;
+    };
+
+    /// @brief If T has a coalesce key. A variant has one if any alternative
+    /// does
+    template <typename T>
+    constexpr bool _InternalHasCoalesceKey = CoalescedMessage<T>;
+
+    template <typename... Ts>
+    constexpr bool _InternalHasCoalesceKey<std::variant<Ts...>> = (CoalescedMessage<Ts> || ...);
+
+    template <typename T>
+    std::optional<size_t> _InternalCoalesceKey(const T& msg) {
+        if constexpr (CoalescedMessage<T>) return msg.CoalesceKey();
+        else return std::nullopt;
+    }
+
+    template <typename T, typename D>
+    std::optional<size_t> _InternalCoalesceKey(const std::unique_ptr<T, D>& msg) {
+        return _InternalCoalesceKey(*msg);
+    }
+
+    template <typename... Ts>
+    std::optional<size_t> _InternalCoalesceKey(const std::variant<Ts...>& msg) {
+        return std::visit([](const auto& alternative) { return _InternalCoalesceKey(alternative); }, msg);
+    }
+
+    /// @brief How a message picks one of the instances registered for its type
+    enum class RoutingPolicy {
+        /// @brief Each message goes to the next instance in turn
+        RoundRobin,
+
+        /// @brief Each message goes to the instance with the fewest pending
+        /// messages
+        LeastLoaded,
+
+        /// @brief Messages go to the instance picked by hashing ShardKey(). The
+        /// message type has to satisfy ShardedMessage
+        KeyHash
+    };
+
+    class ActorScheduler;
+
+    /// @brief A set of messages that can be waited on with
+    /// ActorScheduler::Wait. Messages sent while the group is tracked join
+    /// it, and so does everything sent while handling them
+    class API MessageGroup {
+        friend class ActorScheduler;
+        friend class _InternalExternalWork;
+
+        template <typename T, typename P>
+        friend class _InternalMailboxActor;
+
+    private:
+        std::atomic_size_t pending = 0;
+
+        ActorScheduler* scheduler = nullptr;
+
+        /// @brief Sets the calling thread's group
+        /// @return The previous group
+        static MessageGroup* Swap(MessageGroup* group);
+
+        static MessageGroup* Current();
+
+        /// @brief Marks count messages of this group as handled
+        void Finish(size_t count);
+
+    public:
+        /// @brief While alive, messages sent from this thread join the group
+        class API Scope {
+            friend class ActorScheduler;
+
+        private:
+            MessageGroup* previous;
+
+            Scope(MessageGroup& group) : previous{Swap(&group)} {}
+
+        public:
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+
+            ~Scope() { Swap(previous); }
+        };
+
+        MessageGroup() = default;
+
+        /// @brief Dont allow copy
+        MessageGroup(const MessageGroup&) = delete;
+
+        /// @brief Dont allow copy
+        MessageGroup& operator=(const MessageGroup&) = delete;
+
+        /// @brief Waits for the group, since queued messages point to it
+        ~MessageGroup();
+
+        /// @brief Returns if every message of the group has been handled
+        inline bool Done() const { return pending.load() == 0; }
+    };
+
+    /// @brief The run queue lane an actor is served from. Higher lanes are
+    /// served first
+    enum class Priority {
+        /// @brief Latency critical work, such as the frame
+        High,
+
+        Normal,
+
+        /// @brief Work that only runs when nothing else is waiting
+        Background
+    };
+
+    static constexpr size_t priority_count = 3;
+
+    class _InternalActorBase;
+    class _InternalWorkQueue;
+
+    /// @brief A steady_clock time as a count of its ticks, so it fits in an
+    /// atomic
+    using _InternalClockTicks = std::chrono::steady_clock::rep;
+
+    static constexpr _InternalClockTicks _internal_no_deadline = std::numeric_limits<_InternalClockTicks>::max();
+
+    /// @brief Lowers value to at if at is earlier
+    /// @return \c true if value was lowered
+    inline bool _InternalLowerTicks(std::atomic<_InternalClockTicks>& value, _InternalClockTicks at) {
+        auto current = value.load();
+        while (at < current) {
+            if (value.compare_exchange_weak(current, at)) return true;
+        }
+
+        return false;
+    }
+
+    /// @brief A suspended coroutine waiting to be resumed on its actor
+    struct _InternalResumeNode : public MPSCQueueNode {
+        std::coroutine_handle<> handle;
+        _InternalActorBase* actor;
+
+        /// @brief The group the coroutine was in when it suspended
+        MessageGroup* group;
+    };
+
+    /// @brief A published event waiting for one of its subscribers
+    struct _InternalEventNode : public MPSCQueueNode {
+        /// @brief Shared by every subscriber the event went to
+        std::shared_ptr<const void> event;
+
+        /// @brief Hands the event to the subscriber's HandleEvent
+        void (*handle)(_InternalActorBase* actor, std::shared_ptr<const void>&& event);
+
+        std::chrono::steady_clock::time_point deadline;
+        MessageGroup* group;
+    };
+
+    /// @brief Which threads may run an actor
+    enum class ExecutionClass {
+        /// @brief The compute workers and the main thread
+        Compute,
+
+        /// @brief The blocking pool, for handlers that wait on files, sockets
+        /// or other slow calls. They never hold up a compute thread
+        Blocking,
+
+        /// @brief Only the main thread
+        MainThread
+    };
+
+    /// @brief What happens to a message sent to a full mailbox
+    enum class OverflowPolicy {
+        /// @brief The sender runs other work until there is room. A handler
+        /// sending to its own full mailbox does not wait, since the mailbox
+        /// cannot drain before it returns
+        Block,
+
+        /// @brief The new message is dropped. SendMessage still returns
+        /// \c true
+        DropNewest,
+
+        /// @brief The oldest waiting message is dropped to make room
+        DropOldest,
+
+        /// @brief The new message is dropped and SendMessage returns \c false
+        Reject
+    };
+
+    /// @brief Limits how many messages can wait for an actor
+    struct API MailboxSettings {
+        /// @brief The most messages waiting in the mailbox. 0 is unbounded
+        size_t capacity = 0;
+
+        OverflowPolicy overflow = OverflowPolicy::Reject;
+
+        /// @brief A new message whose CoalesceKey matches a waiting message
+        /// replaces it. The new message still goes to the back, so it stays in
+        /// order with everything sent before it, and the replaced one is
+        /// skipped. Until then the replaced one takes room in the mailbox.
+        /// Needs a message type that satisfies CoalescedMessage
+        bool coalesce = false;
+    };
+
     class API _InternalActorBase {
         friend class ActorScheduler;
+        friend class _InternalActorPool;
+        friend class _InternalRunQueue;
+        friend class _InternalLaneQueue;
+        friend class _InternalWorkQueue;
+    private:
+        /// @brief The number of messages accepted but not handled yet. The
+        /// actor is queued to run only when this goes from 0 to 1, and
+        /// requeued after a run only if it is still not 0. So an actor has at
+        /// most one run queue entry and never runs on two threads at once
+        std::atomic_size_t pending_messages = 0;
+
+        /// @brief From GetExecutionClass
+        ExecutionClass execution = ExecutionClass::Compute;
+
+        /// @brief The mailbox holds messages by value rather than MessagePtr
+        bool stores_values = false;
+
+        /// @brief The worker that last ran this actor, for soft affinity
+        std::atomic_size_t last_worker = static_cast<size_t>(-1);
+
+        /// @brief The lane from GetPriority
+        Priority priority = Priority::Normal;
+
+        /// @brief The lane to use the next time the actor is queued. Messages
+        /// sent with a higher priority raise it
+        std::atomic<Priority> next_lane = Priority::Normal;
+
+        /// @return \c false if next_lane was already at least as high
+        bool RaiseLane(Priority lane) {
+            auto current = next_lane.load();
+            while (lane < current) {
+                if (next_lane.compare_exchange_weak(current, lane)) return true;
+            }
+
+            return false;
+        }
+
+        /// @brief Links for the run queue this actor is in, if any
+        _InternalActorBase* run_prev = nullptr;
+        _InternalActorBase* run_next = nullptr;
+
+        /// @brief The queue and lane the actor is waiting in, so raising its
+        /// lane can move it. Changed under the lock of that queue
+        std::atomic<_InternalWorkQueue*> run_queue = nullptr;
+        Priority run_lane = Priority::Normal;
+
+        /// @brief When the earliest deadline of the waiting messages makes the
+        /// actor urgent, or _internal_no_deadline. Checked when a queue the
+        /// actor waits in is popped, and cleared when the actor runs
+        std::atomic<_InternalClockTicks> urgent_at = _internal_no_deadline;
+
+        /// @brief Coroutines of this actor that are ready to continue. Each
+        /// one counts in pending_messages like a message
+        MPSCQueue<_InternalResumeNode> resumes;
+
+        /// @brief Published events for this actor. Each one counts in
+        /// pending_messages like a message, but not against the mailbox limit
+        MPSCQueue<_InternalEventNode> events;
+
+        void AddQueued() {
+            auto size = queued.fetch_add(1, std::memory_order_relaxed) + 1;
+
+            auto high = high_water.load(std::memory_order_relaxed);
+            while (size > high && !high_water.compare_exchange_weak(high, size, std::memory_order_relaxed)) {}
+        }
+
+        /// @brief Counts a message as queued if the mailbox has room
+        bool TryAddQueued(size_t capacity) {
+            auto size = queued.load(std::memory_order_relaxed);
+
+            while (size < capacity) {
+                if (queued.compare_exchange_weak(size, size + 1, std::memory_order_relaxed)) {
+                    auto high = high_water.load(std::memory_order_relaxed);
+                    while (size + 1 > high && !high_water.compare_exchange_weak(high, size + 1, std::memory_order_relaxed)) {}
+
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+    protected:
+        std::atomic_size_t missed_deadlines = 0;
+
+        /// @brief From GetMailboxSettings
+        MailboxSettings mailbox_settings;
+
+        /// @brief Messages waiting in the mailbox
+        std::atomic_size_t queued = 0;
+
+        /// @brief The most messages that have waited in the mailbox at once
+        std::atomic_size_t high_water = 0;
+
+        /// @brief Messages dropped by the overflow policy
+        std::atomic_size_t dropped_messages = 0;
+
+        /// @brief Waiting messages replaced by a newer one with the same key
+        std::atomic_size_t coalesced_messages = 0;
+
+        /// @brief Handles count messages from the mailbox. The scheduler only
+        /// asks for messages that have been accepted
+        virtual void ProcessMessages(size_t count) = 0;
+
+    public:
+        /// @brief Coroutines still waiting to resume are destroyed
+        virtual ~_InternalActorBase() {
+            while (auto node = resumes.Pop()) {
+                node->handle.destroy();
+                MessagePool<_InternalResumeNode>::Delete(node);
+            }
+
+            while (auto node = events.Pop()) MessagePool<_InternalEventNode>::Delete(node);
+        }
+
+        /// @brief Shorthand for ExecutionClass::MainThread
+        virtual bool MainThreadOnly() const { return false; }
+
+        /// @brief Which threads run this actor. Read once at registration
+        virtual ExecutionClass GetExecutionClass() const {
+            return MainThreadOnly() ? ExecutionClass::MainThread : ExecutionClass::Compute;
+        }
+
+        /// @brief The lane this actor is queued in by default
+        virtual Priority GetPriority() const { return Priority::Normal; }
+
+        /// @brief The number of messages that were handled after their
+        /// deadline
+        inline size_t GetMissedDeadlines() const { return missed_deadlines.load(); }
+
+        /// @brief The mailbox limit of this actor. Read once at registration
+        virtual MailboxSettings GetMailboxSettings() const { return {}; }
+
+        /// @brief The most messages that have waited in the mailbox at once
+        inline size_t GetMailboxHighWaterMark() const { return high_water.load(); }
+
+        /// @brief The number of messages dropped because the mailbox was full
+        inline size_t GetDroppedMessages() const { return dropped_messages.load(); }
+
+        /// @brief The number of messages replaced by a newer one with the
+        /// same coalesce key
+        inline size_t GetCoalescedMessages() const { return coalesced_messages.load(); }
+    };
+
+    /// @brief Gives MPSCQueue the interface of SegmentedQueue, with every
+    /// element in its own pooled node
+    template <typename T>
+    class _InternalLinkedMailbox {
+    private:
+        struct Node : public MPSCQueueNode, public T {};
+
+        MPSCQueue<Node> queue;
+
+    public:
+        ~_InternalLinkedMailbox() {
+            while (auto item = Pop()) Release(item);
+        }
+
+        inline T* Claim() { return MessagePool<Node>::New(); }
+
+        inline void Publish(T* item) { queue.Push(static_cast<Node*>(item)); }
+
+        inline T* Pop() { return queue.Pop(); }
+
+        inline void Release(T* item) { MessagePool<Node>::Delete(static_cast<Node*>(item)); }
+    };
+
+    /// @brief The mailbox and draining shared by every actor that handles T.
+    /// Payload is how a message is held, either MessagePtr<T> or T itself
+    template <typename T, typename P>
+    class _InternalMailboxActor : public _InternalActorBase {
+        static_assert(std::is_move_assignable_v<T> || std::is_move_constructible_v<T>);
+
+        friend class ActorScheduler;
+
+    public:
+        using MessageType = T;
+        using Payload = P;
+
+    private:
+        struct MailboxEntry {
+            /// @brief Empty once a newer message with the same coalesce key
+            /// replaced it. The actor skips the entry then
+            std::optional<Payload> msg;
+
+            std::chrono::steady_clock::time_point deadline;
+            MessageGroup* group = nullptr;
+
+            /// @brief The coalesce key the entry is registered under, if any
+            std::optional<size_t> key;
+        };
+
+        /// @brief A MessagePtr is only a pointer, so those entries are kept
+        /// in pooled nodes. Messages held by value are kept in place in
+        /// segments, so draining reads them from contiguous memory
+        using Mailbox = std::conditional_t<std::is_same_v<Payload, MessagePtr<T>>, _InternalLinkedMailbox<MailboxEntry>, SegmentedQueue<MailboxEntry>>;
+
+        Mailbox mailbox;
+
+        struct CoalesceSlot {
+            size_t key = 0;
+            MailboxEntry* entry = nullptr;
+        };
+
+        static constexpr size_t coalesce_slots = 16;
+
+        /// @brief Waiting entries by coalesce key, in a fixed table so sending
+        /// never allocates. Keys that share a slot take it from each other,
+        /// and only the one registered last can be replaced. Guarded by
+        /// coalesce_lock
+        CoalesceSlot coalescing[coalesce_slots];
+        std::atomic_flag coalesce_lock;
+
+        void LockCoalesce() {
+            while (coalesce_lock.test_and_set(std::memory_order_acquire)) std::this_thread::yield();
+        }
+
+        void UnlockCoalesce() {
+            coalesce_lock.clear(std::memory_order_release);
+        }
+
+        /// @brief Stops a popped entry from being coalesced into. Once this
+        /// returns no sender touches the entry
+        void Uncoalesce(MailboxEntry* entry) {
+            if (!entry->key) return;
+
+            LockCoalesce();
+
+            auto& slot = coalescing[*entry->key % coalesce_slots];
+            if (slot.entry == entry) slot.entry = nullptr;
+
+            UnlockCoalesce();
+
+            entry->key = std::nullopt;
+        }
+
+        /// @brief Publishes a filled in entry. If a message with the same key
+        /// is waiting it is replaced. It stays in the mailbox, in order, and
+        /// is skipped when reached, while the new one goes to the back
+        void Enqueue(MailboxEntry* entry) {
+            if (!entry->key) {
+                mailbox.Publish(entry);
+                return;
+            }
+
+            std::optional<Payload> replaced;
+            MessageGroup* replaced_group = nullptr;
+
+            LockCoalesce();
+
+            auto& slot = coalescing[*entry->key % coalesce_slots];
+
+            // A registered entry has not been read by the consumer, since it
+            // unregisters an entry before reading it
+            if (slot.entry && slot.key == *entry->key) {
+                replaced = std::move(slot.entry->msg);
+                slot.entry->msg.reset();
+
+                replaced_group = std::exchange(slot.entry->group, nullptr);
+            }
+
+            slot.key = *entry->key;
+            slot.entry = entry;
+
+            // Register before publishing, so the consumer cannot pop the
+            // entry before it can be unregistered
+            mailbox.Publish(entry);
+
+            UnlockCoalesce();
+
+            if (!replaced) return;
+
+            coalesced_messages++;
+            if (replaced_group) replaced_group->Finish(1);
+        }
+
+        /// @brief With OverflowPolicy::DropOldest senders pop from the
+        /// mailbox too, so popping takes this lock
+        std::atomic_flag pop_lock;
+
+        void LockPop() {
+            if (mailbox_settings.overflow != OverflowPolicy::DropOldest) return;
+
+            while (pop_lock.test_and_set(std::memory_order_acquire)) std::this_thread::yield();
+        }
+
+        void UnlockPop() {
+            if (mailbox_settings.overflow != OverflowPolicy::DropOldest) return;
+
+            pop_lock.clear(std::memory_order_release);
+        }
+
+        /// @brief Reused between runs so draining does not allocate
+        std::vector<Payload> batch;
+    
+    public:
+        virtual void HandleMessage(Payload&& msg) = 0;
+
+        /// @brief Handles a batch of messages taken from the mailbox in one
+        /// go. Override this for actors that can process messages in bulk
+        /// @param msgs The messages, oldest first
+        virtual void HandleMessages(std::span<Payload> msgs) {
+            for (auto& msg : msgs) HandleMessage(std::move(msg));
+        }
+    
     protected:
-        virtual void ProcessMessage() = 0;
+        /// @param key Replaces the waiting message with the same key, and
+        /// registers this one to be replaced in turn
+        void AcceptMessage(Payload&& msg, std::chrono::steady_clock::time_point deadline, MessageGroup* group, std::optional<size_t> key = std::nullopt) {
+            auto entry = mailbox.Claim();
+            entry->msg.emplace(std::move(msg));
+            entry->deadline = deadline;
+            entry->group = group;
+            entry->key = key;
+
+            Enqueue(entry);
+        }
+
+        /// @brief Drops the oldest message and queues msg in its place. The
+        /// message count of the mailbox stays the same
+        /// @param key Like AcceptMessage
+        /// @return \c false if the mailbox was empty
+        bool ReplaceOldest(Payload&& msg, std::chrono::steady_clock::time_point deadline, MessageGroup* group, std::optional<size_t> key = std::nullopt) {
+            LockPop();
+
+            auto oldest = mailbox.Pop();
+
+            if (!oldest) {
+                UnlockPop();
+                return false;
+            }
+
+            Uncoalesce(oldest);
+
+            // A replaced entry was already dropped and counted
+            bool dropped = oldest->msg.has_value();
+            auto dropped_group = oldest->group;
+            mailbox.Release(oldest);
+
+            auto entry = mailbox.Claim();
+            entry->msg.emplace(std::move(msg));
+            entry->deadline = deadline;
+            entry->group = group;
+            entry->key = key;
+
+            // Publish before unlocking, so the consumer never sees the
+            // mailbox one message short
+            Enqueue(entry);
+
+            UnlockPop();
+
+            if (dropped) dropped_messages++;
+            if (dropped_group) dropped_group->Finish(1);
+
+            return true;
+        }
+
+        /// @brief Handles the batch with its group current, so messages sent
+        /// by the handler join the same group
+        void HandleBatch(MessageGroup* group) {
+            auto previous = MessageGroup::Swap(group);
+            HandleMessages(batch);
+            MessageGroup::Swap(previous);
+
+            if (group) group->Finish(batch.size());
+
+            batch.clear();
+        }
+
+        void ProcessMessages(size_t count) override {
+            MessageGroup* group = nullptr;
+
+            for (size_t i = 0; i < count; i++) {
+                // The entry is released before unlocking, as a sender
+                // dropping the oldest message would pop it again otherwise
+                LockPop();
+
+                auto entry = mailbox.Pop();
+
+                Uncoalesce(entry);
+
+                // Replaced by a newer message, which finished its group
+                if (!entry->msg) {
+                    mailbox.Release(entry);
+
+                    UnlockPop();
+
+                    queued.fetch_sub(1, std::memory_order_relaxed);
+                    continue;
+                }
+
+                auto msg = std::move(*entry->msg);
+                auto deadline = entry->deadline;
+                auto entry_group = entry->group;
+
+                mailbox.Release(entry);
+
+                UnlockPop();
+
+                queued.fetch_sub(1, std::memory_order_relaxed);
+
+                if (deadline != std::chrono::steady_clock::time_point::max() && std::chrono::steady_clock::now() > deadline)
+                    missed_deadlines++;
+
+                // A batch only holds messages of one group
+                if (entry_group != group && !batch.empty()) HandleBatch(group);
+
+                group = entry_group;
+
+                batch.push_back(std::move(msg));
+            }
+
+            HandleBatch(group);
+        };
+    };
+
+    /// @brief An actor for messages of type T. Each message is held by a
+    /// MessagePtr, so T can be a base class of the messages sent
+    template <typename T>
+    class API Actor : public _InternalMailboxActor<T, MessagePtr<T>> {};
+
+    /// @brief An actor for messages of type T held by value. The mailbox
+    /// stores them in contiguous segments, so sending one does not allocate
+    /// and draining reads them in order without chasing pointers. Meant for
+    /// small messages. Override HandleMessage(T&&)
+    template <typename T>
+    class API ValueActor : public _InternalMailboxActor<T, T> {};
+
+    /// @brief Declares the handler of one alternative of a VariantActor
+    template <typename T>
+    class _InternalVariantHandler {
+    public:
+        virtual ~_InternalVariantHandler() = default;
+
+        virtual void HandleMessage(T&& msg) = 0;
+    };
+
+    /// @brief An actor for a closed set of message types. Messages are held
+    /// by value like in a ValueActor, and dispatch is a single std::visit.
+    /// Override HandleMessage for every type, and send with
+    /// EmplaceMessageAs<MessageType>(msg)
+    template <typename... Ts>
+    class API VariantActor : public _InternalMailboxActor<std::variant<Ts...>, std::variant<Ts...>>, public _InternalVariantHandler<Ts>... {
+    public:
+        using _InternalVariantHandler<Ts>::HandleMessage...;
+
+        void HandleMessage(std::variant<Ts...>&& msg) final {
+            std::visit([this](auto& alternative) { this->HandleMessage(std::move(alternative)); }, msg);
+        }
+    };
+
+    /// @brief Lets an actor receive the events of type E sent with
+    /// ActorScheduler::Publish. Inherit it next to the actor base, one per
+    /// event type, and call ActorScheduler::Subscribe after registering. Every
+    /// subscriber gets the same immutable event
+    template <typename E>
+    class Subscriber {
+    public:
+        virtual ~Subscriber() = default;
+
+        virtual void HandleEvent(std::shared_ptr<const E> event) = 0;
+    };
+
+    template <typename E, typename A>
+    void _InternalHandleEvent(_InternalActorBase* actor, std::shared_ptr<const void>&& event) {
+        static_cast<Subscriber<E>*>(static_cast<A*>(actor))->HandleEvent(std::static_pointer_cast<const E>(std::move(event)));
+    }
+
+    /// @brief How the ActorScheduler hands out work to its threads
+    enum class SchedulingMode {
+        /// @brief Every thread pops from one shared queue
+        Shared,
+
+        /// @brief Every worker owns a deque. Messages sent from a worker are
+        /// queued on its own deque and idle workers steal from the others
+        WorkStealing
+    };
+
+    /// @brief What a worker does when it finds no work. It first polls
+    /// spin_count times, then yields yield_count times and finally parks
+    /// until a message is sent
+    struct API IdleStrategy {
+        /// @brief How many times to poll for work before yielding
+        size_t spin_count = 64;
+
+        /// @brief How many times to yield before parking
+        size_t yield_count = 16;
+
+        /// @brief If \c false the worker keeps yielding instead of parking
+        bool park = true;
+    };
+
+    /// @brief Where the worker threads run
+    struct API ThreadTopology {
+        /// @brief Pins each thread to its own core. The main thread gets the
+        /// first core and the workers the ones after it, so the main thread
+        /// never competes with a worker while it helps. Cores of one NUMA node
+        /// are used before moving on to the next
+        bool pin_threads = false;
+
+        /// @brief Makes idle workers steal from workers on their own NUMA node
+        /// before crossing to another. Only useful with pin_threads
+        bool steal_within_node = true;
+    };
+
+    /// @brief Options used when creating the ActorScheduler
+    struct API ActorSchedulerSettings {
+        /// @brief How work is distributed between the threads
+        SchedulingMode mode = SchedulingMode::Shared;
+
+        /// @brief What idle workers do
+        IdleStrategy idle;
+
+        /// @brief The most messages an actor handles each time it is
+        /// dispatched before the thread goes back to the scheduler
+        size_t throughput = 8;
+
+        /// @brief How many times a lane with work can be passed over for a
+        /// higher one before it is served anyway
+        size_t starvation_limit = 32;
+
+        /// @brief Thread placement
+        ThreadTopology topology;
+
+        /// @brief With SchedulingMode::WorkStealing, queue a ready actor on the
+        /// worker that last ran it so its state stays in that core's cache.
+        /// Other workers still steal it if that worker is busy
+        bool actor_affinity = true;
+
+        /// @brief Threads for ExecutionClass::Blocking actors, on top of the
+        /// compute threads. They are started when a blocking actor first has
+        /// work, so a scheduler without such work never creates them. With 0
+        /// those actors run as Compute
+        size_t blocking_threads = 2;
+
+        /// @brief How close a message has to be to its deadline for its actor
+        /// to run in the High lane. A message sent earlier moves the actor up
+        /// the next time its queue is popped after it gets this close
+        std::chrono::steady_clock::duration deadline_lead = std::chrono::milliseconds(2);
+    };
+
+    /// @brief Optional per message delivery settings. A mailbox is still
+    /// handled in order, so these decide when the actor runs next and the
+    /// message waits for the ones sent before it
+    struct API SendOptions {
+        /// @brief Runs the actor in this lane if it is higher than the
+        /// actor's own priority. An actor already waiting in a lower lane is
+        /// moved up
+        std::optional<Priority> priority;
+
+        /// @brief When the message should be handled by. The actor moves to
+        /// the High lane once the deadline is within
+        /// ActorSchedulerSettings::deadline_lead, and late messages are
+        /// counted by the actor
+        std::optional<std::chrono::steady_clock::time_point> deadline;
+    };
+
+    /// @brief Identifies a timer so it can be cancelled
+    struct API TimerHandle {
+        uint32_t index = static_cast<uint32_t>(-1);
+        uint32_t generation = 0;
+    };
+
+    /// @brief A timer in the ActorScheduler's timing wheel. Timers link into
+    /// the wheel's slots directly, so adding one only allocates from a pool
+    struct _InternalTimer {
+        _InternalTimer* prev = nullptr;
+        _InternalTimer* next = nullptr;
+
+        /// @brief The tick the timer fires at
+        uint64_t due = 0;
+
+        /// @brief Ticks between firings, or 0 to fire once
+        uint64_t period = 0;
+
+        /// @brief Where the timer is in the wheel
+        uint32_t slot = 0;
+
+        /// @brief The index of its TimerHandle
+        uint32_t handle = 0;
+
+        void (*fire)(_InternalTimer* timer, ActorScheduler* scheduler) = nullptr;
+
+        /// @brief Frees a timer that will not fire again
+        void (*destroy)(_InternalTimer* timer) = nullptr;
+    };
+
+    template <typename As, typename Type>
+    struct _InternalSendTimer;
+
+    class _InternalTimerWheel;
+
+    /// @brief An intrusive list of ready actors. An actor is in at most one
+    /// run queue at a time, so queuing it never allocates. This does no
+    /// locking of its own
+    class API _InternalRunQueue {
+        friend class _InternalLaneQueue;
+
+    private:
+        _InternalActorBase* first = nullptr;
+        _InternalActorBase* last = nullptr;
+
+    public:
+        inline bool Empty() const { return first == nullptr; }
+
+        void PushBack(_InternalActorBase* actor) {
+            actor->run_prev = last;
+            actor->run_next = nullptr;
+
+            if (last) last->run_next = actor;
+            else first = actor;
+
+            last = actor;
+        }
+
+        _InternalActorBase* PopFront() {
+            auto actor = first;
+            if (!actor) return nullptr;
+
+            first = actor->run_next;
+            if (first) first->run_prev = nullptr;
+            else last = nullptr;
+
+            actor->run_next = nullptr;
+            return actor;
+        }
+
+        _InternalActorBase* PopBack() {
+            auto actor = last;
+            if (!actor) return nullptr;
+
+            last = actor->run_prev;
+            if (last) last->run_next = nullptr;
+            else first = nullptr;
+
+            actor->run_prev = nullptr;
+            return actor;
+        }
+
+        /// @brief Unlinks an actor that is in this queue
+        void Remove(_InternalActorBase* actor) {
+            if (actor->run_prev) actor->run_prev->run_next = actor->run_next;
+            else first = actor->run_next;
+
+            if (actor->run_next) actor->run_next->run_prev = actor->run_prev;
+            else last = actor->run_prev;
+
+            actor->run_prev = nullptr;
+            actor->run_next = nullptr;
+        }
+    };
+
+    /// @brief A run queue per Priority. The highest lane with work is served,
+    /// unless a lower lane has been passed over starvation_limit times. This
+    /// does no locking of its own
+    class API _InternalLaneQueue {
+    private:
+        _InternalRunQueue lanes[priority_count];
+        size_t skipped[priority_count] = {};
+
+    public:
+        inline void Push(_InternalActorBase* actor, Priority lane) {
+            lanes[static_cast<size_t>(lane)].PushBack(actor);
+            actor->run_lane = lane;
+        }
+
+        /// @brief Moves a queued actor to the back of a higher lane
+        void Raise(_InternalActorBase* actor, Priority lane) {
+            if (lane >= actor->run_lane) return;
+
+            lanes[static_cast<size_t>(actor->run_lane)].Remove(actor);
+            Push(actor, lane);
+        }
+
+        /// @brief Moves the actors that are urgent by now to the High lane
+        /// @return The earliest time a waiting actor becomes urgent, or
+        /// _internal_no_deadline
+        _InternalClockTicks PromoteUrgent(_InternalClockTicks now) {
+            auto earliest = _internal_no_deadline;
+
+            for (size_t i = static_cast<size_t>(Priority::High) + 1; i < priority_count; i++) {
+                auto actor = lanes[i].first;
+
+                while (actor) {
+                    auto next = actor->run_next;
+                    auto urgent = actor->urgent_at.load();
+
+                    if (urgent <= now) Raise(actor, Priority::High);
+                    else earliest = std::min(earliest, urgent);
+
+                    actor = next;
+                }
+            }
+
+            return earliest;
+        }
+
+        bool Empty() const {
+            for (auto& lane : lanes) {
+                if (!lane.Empty()) return false;
+            }
 
-    public:
-        virtual ~_InternalActorBase() = default;
-        
-        virtual bool MainThreadOnly() const { return false; }
-    };
+            return true;
+        }
 
-    template <typename T>
-    class API Actor : public _InternalActorBase {
-        static_assert(std::is_move_assignable_v<T> || std::is_move_constructible_v<T>);
+        /// @brief Takes the next actor
+        /// @param newest \c true to take the newest actor of the lane, \c false
+        /// for the oldest
+        /// @param starvation_limit See ActorSchedulerSettings
+        _InternalActorBase* Pop(bool newest, size_t starvation_limit) {
+            size_t chosen = priority_count;
 
-        friend class ActorScheduler;
+            for (size_t i = 0; i < priority_count; i++) {
+                if (lanes[i].Empty()) continue;
+
+                if (chosen == priority_count || skipped[i] >= starvation_limit) chosen = i;
+            }
+
+            if (chosen == priority_count) return nullptr;
+
+            skipped[chosen] = 0;
+
+            for (size_t i = chosen + 1; i < priority_count; i++) {
+                if (!lanes[i].Empty()) skipped[i]++;
+            }
+
+            return newest ? lanes[chosen].PopBack() : lanes[chosen].PopFront();
+        }
+    };
 
+    /// @brief A lane queue with its own lock. Every run queue of the
+    /// scheduler is one, so an actor whose lane is raised while it waits can
+    /// be moved up. A worker pushes and pops its own deque from the bottom
+    /// (LIFO), other threads steal from the top (FIFO). Shared queues are only
+    /// taken from the top
+    class API _InternalWorkQueue {
     private:
         std::mutex lock;
-        std::vector<std::unique_ptr<T>> mailbox;
-    
-    public:
-        using MessageType = T;
+        _InternalLaneQueue queue;
 
-        virtual ~Actor() = default;
+        /// @brief The earliest time an actor waiting below the High lane
+        /// becomes urgent. It may be early, but never late
+        std::atomic<_InternalClockTicks> urgent = _internal_no_deadline;
 
-        virtual void HandleMessage(std::unique_ptr<T>&& msg) = 0;
-    
-    protected:
-        void AcceptMessage(std::unique_ptr<T>&& msg) {
+        _InternalActorBase* Take(bool newest, size_t starvation_limit) {
+            auto earliest = urgent.load(std::memory_order_relaxed);
+            auto now = earliest != _internal_no_deadline ? std::chrono::steady_clock::now().time_since_epoch().count() : 0;
+
+            lock.lock();
+
+            if (earliest != _internal_no_deadline && earliest <= now) {
+                // Reset first, so a deadline noted during the scan is kept
+                urgent.store(_internal_no_deadline);
+                _InternalLowerTicks(urgent, queue.PromoteUrgent(now));
+            }
+
+            auto actor = queue.Pop(newest, starvation_limit);
+            if (actor) actor->run_queue.store(nullptr, std::memory_order_relaxed);
+
+            lock.unlock();
+
+            return actor;
+        }
+
+    public:
+        /// @brief Queues actor in its next lane, which goes back to its own
+        /// priority
+        void Push(_InternalActorBase* actor) {
             lock.lock();
-            mailbox.push_back(std::move(msg));
+
+            // Set before the lane is taken. A sender that raises the lane
+            // after this finds the queue and moves the actor itself
+            actor->run_queue.store(this);
+
+            auto lane = actor->next_lane.exchange(actor->priority);
+            queue.Push(actor, lane);
+
+            if (lane != Priority::High) _InternalLowerTicks(urgent, actor->urgent_at.load());
+
             lock.unlock();
         }
 
-        void ProcessMessage() override {
+        /// @brief Notes that an actor waiting here becomes urgent at this time
+        inline void NoteUrgent(_InternalClockTicks at) { _InternalLowerTicks(urgent, at); }
+
+        /// @brief Moves actor up to lane if it is still waiting here
+        void Raise(_InternalActorBase* actor, Priority lane) {
             lock.lock();
 
-            auto msg = std::move(mailbox.front());
-            mailbox.erase(mailbox.begin());
+            if (actor->run_queue.load(std::memory_order_relaxed) == this) {
+                // The raise is used up here, so the next push starts over
+                auto next = actor->next_lane.exchange(actor->priority);
+                queue.Raise(actor, std::min(lane, next));
+            }
+
+            lock.unlock();
+        }
 
+        bool Empty() {
+            lock.lock();
+            auto empty = queue.Empty();
             lock.unlock();
 
-            HandleMessage(std::move(msg));
-        };
+            return empty;
+        }
+
+        inline _InternalActorBase* Pop(size_t starvation_limit) { return Take(true, starvation_limit); }
+
+        inline _InternalActorBase* Steal(size_t starvation_limit) { return Take(false, starvation_limit); }
+    };
+
+    /// @brief The instances registered for one message type
+    class API _InternalActorPool {
+    private:
+        std::vector<std::unique_ptr<_InternalActorBase>> instances;
+
+        const RoutingPolicy policy;
+
+        std::atomic_size_t next = 0;
+
+    public:
+        _InternalActorPool(std::vector<std::unique_ptr<_InternalActorBase>>&& instances, RoutingPolicy policy) : instances{std::move(instances)}, policy{policy} {}
+
+        inline RoutingPolicy GetPolicy() const { return policy; }
+
+        /// @brief Picks an instance for a message without a key
+        _InternalActorBase* Pick();
+
+        /// @brief Picks the instance for a key
+        inline _InternalActorBase* PickByHash(size_t hash) const {
+            return instances[hash % instances.size()].get();
+        }
+
+        inline size_t Size() const { return instances.size(); }
+
+        inline _InternalActorBase* Get(size_t index) const { return instances[index].get(); }
+
+        inline _InternalActorBase* Front() const { return instances.front().get(); }
+    };
+
+    /// @brief One actor subscribed to a topic
+    struct API _InternalSubscription {
+        _InternalActorBase* actor;
+        void (*handle)(_InternalActorBase* actor, std::shared_ptr<const void>&& event);
+    };
+
+    /// @brief An immutable routing table, indexed by message slot. The
+    /// scheduler publishes a new one for every registration, so sending can
+    /// read it without a lock
+    struct API _InternalActorRegistry {
+        std::vector<_InternalActorPool*> routes;
+
+        /// @brief The subscribers of each event type
+        std::vector<std::vector<_InternalSubscription>> topics;
     };
 
     class API ActorScheduler {
+        friend class MessageGroup;
+        friend class _InternalExternalWork;
+
     private:
-        using ActorPtr = std::shared_ptr<_InternalActorBase>;
+        std::atomic_bool running = true;
+
+        const ActorSchedulerSettings settings;
 
-        bool running = true;
+        std::mutex idle_lock;
+        std::condition_variable idle_cv;
+        std::atomic_size_t sleeping = 0;
+        std::atomic_size_t wake_epoch = 0;
 
         std::mutex lock;
 
-        std::unordered_map<std::type_index, ActorPtr> actors;
-        std::unordered_map<std::type_index, bool> actors_is_main;
+        std::vector<std::unique_ptr<_InternalActorPool>> pools;
+
+        /// @brief The current routing table. Readers load it without locking
+        std::atomic<const _InternalActorRegistry*> registry = nullptr;
+
+        /// @brief Every table ever published. A sender may still be reading a
+        /// replaced table, so they are only freed with the scheduler
+        std::vector<std::unique_ptr<_InternalActorRegistry>> registries;
+
+        /// @brief Set by Seal. Only RegisterLate may add actors after this
+        std::atomic_bool sealed = false;
+
+        /// @brief The thread that created the scheduler. Only it runs
+        /// ExecutionClass::MainThread actors
+        const std::thread::id main_thread = std::this_thread::get_id();
 
-        std::list<ActorPtr> to_do;
-        std::list<ActorPtr> main_to_do;
+        // The actors are owned by pools, which outlives every queue
+        _InternalWorkQueue to_do;
+        _InternalWorkQueue main_to_do;
 
+        std::vector<std::unique_ptr<_InternalWorkQueue>> worker_queues;
         std::vector<std::thread> threads;
 
-        ActorScheduler(size_t thread_count);
+        /// @brief Ready ExecutionClass::Blocking actors. Only the blocking
+        /// threads take from it. They sleep on blocking_cv under
+        /// blocking_lock
+        _InternalWorkQueue blocking_to_do;
+        std::mutex blocking_lock;
+        std::condition_variable blocking_cv;
+
+        /// @brief The blocking threads, empty until the first blocking actor
+        /// is scheduled. Guarded by blocking_lock
+        std::vector<std::thread> blocking_pool;
+
+        /// @brief Starts ActorSchedulerSettings::blocking_threads threads.
+        /// Must be called with blocking_lock held
+        void StartBlockingThreads();
+
+        /// @brief The order each worker tries the others when stealing
+        std::vector<std::vector<size_t>> steal_order;
+
+        ActorScheduler(size_t thread_count, const ActorSchedulerSettings& settings);
 
         void YieldCPU() const;
 
+        void WorkerLoop();
+
+        void Park();
+
+        void WakeWorker();
+
+        void Schedule(_InternalActorBase* actor);
+
+        /// @brief Raises the lane of actor, moving it up if it is already
+        /// waiting in a lower one
+        void Raise(_InternalActorBase* actor, Priority lane);
+
+        /// @brief Applies the priority of a message to actor, and raises it
+        /// if the deadline is already close. Call it before the message is
+        /// counted in pending_messages
+        void Prioritize(_InternalActorBase* actor, const SendOptions& options);
+
+        /// @brief Records the deadline of a message on actor, so its queue
+        /// moves it up once the deadline gets close. Call it after the
+        /// message is counted in pending_messages
+        void TrackDeadline(_InternalActorBase* actor, const SendOptions& options);
+
+        _InternalActorBase* FindWork(bool is_main);
+
         bool ProcessMessage(bool is_main = false);
 
-        std::atomic_size_t working = 0;
+        /// @brief Handles a batch of the messages of actor on this thread
+        void RunActor(_InternalActorBase* actor);
 
-    public:
-        ~ActorScheduler();
+        void BlockingLoop();
+
+        /// @brief Runs one ready blocking actor, if there is one
+        bool ProcessBlockingMessage();
+
+        /// @brief Runs work the calling thread is allowed to run, for a thread
+        /// that has to wait. Threads that are not the scheduler's only help
+        /// with compute work
+        bool ProcessLocalMessage();
+
+        inline bool IsMainThread() const { return std::this_thread::get_id() == main_thread; }
+
+        /// @brief Messages sent but not handled yet. Incremented before a
+        /// message is queued and decremented after it is handled, so the
+        /// system is idle exactly when this is 0
+        std::atomic_size_t in_flight = 0;
+
+        /// @brief Work running outside the actors that still reports back,
+        /// such as file I/O. The scheduler waits for it before it is destroyed
+        std::atomic_size_t external_work = 0;
+
+        std::mutex quiescence_lock;
+        std::condition_variable quiescence_cv;
+        std::atomic_bool main_waiting = false;
+        std::atomic_size_t main_epoch = 0;
+
+        /// @brief Blocks the main thread until there is work for it or
+        /// counter is 0
+        void WaitForMainThreadWork(const std::atomic_size_t& counter);
+
+        /// @brief Runs messages on the calling thread until counter is 0. The
+        /// main thread sleeps when there is nothing it can run, other threads
+        /// yield
+        void HelpUntil(const std::atomic_size_t& counter);
+
+        /// @brief Prepares a coroutine of the running actor to suspend
+        /// @param join_group Keeps the current group waiting until the
+        /// coroutine resumes, and resumes it in that group
+        _InternalResumeNode* Suspend(std::coroutine_handle<> handle, bool join_group = true);
+
+        /// @brief The scheduler running the actor on the calling thread
+        static ActorScheduler* Running();
+
+        /// @brief Queues a suspended coroutine to resume on its actor. This
+        /// can be called from any thread. Once the scheduler is shutting down
+        /// the coroutine is destroyed instead
+        void PostResume(_InternalResumeNode* node);
+
+        /// @brief Resumes up to limit coroutines of actor
+        /// @return How many were resumed
+        size_t RunResumes(_InternalActorBase* actor, size_t limit);
+
+        /// @brief Queues a published event for one subscriber
+        void PostEvent(const _InternalSubscription& subscription, const std::shared_ptr<const void>& event, const SendOptions& options);
+
+        /// @brief Handles up to limit published events of actor
+        /// @return How many were handled
+        size_t RunEvents(_InternalActorBase* actor, size_t limit);
+
+        static constexpr uint64_t no_timer = static_cast<uint64_t>(-1);
+
+        /// @brief Guarded by timer_lock
+        std::unique_ptr<_InternalTimerWheel> timers;
+        std::mutex timer_lock;
+
+        /// @brief The tick of the next timer, so threads can check it without
+        /// locking. A tick is 1 ms after timer_start
+        std::atomic_uint64_t next_timer = no_timer;
+
+        const std::chrono::steady_clock::time_point timer_start = std::chrono::steady_clock::now();
+
+        TimerHandle AddTimer(_InternalTimer* timer, std::chrono::steady_clock::duration delay, std::chrono::steady_clock::duration period);
+
+        /// @brief Fires the timers that are due. Called by every thread looking
+        /// for work. One of them at a time takes the due timers, and fires them
+        /// after releasing timer_lock
+        void PollTimers();
+
+        inline std::chrono::steady_clock::time_point TickTime(uint64_t tick) const {
+            return timer_start + std::chrono::milliseconds(tick);
+        }
+
+        template <typename R>
+        friend class _InternalFutureAwaiter;
+
+        friend class _InternalSleepAwaiter;
+
+        enum class Admission {
+            /// @brief The message was counted in the mailbox
+            Accepted,
+
+            /// @brief The message takes the place of the oldest one
+            Replace,
+
+            Dropped,
+
+            Rejected
+        };
+
+        /// @brief Applies actor's mailbox limit to a message about to be sent
+        Admission Admit(_InternalActorBase* actor);
+
+        friend void _InternalHelpUntil(ActorScheduler* scheduler, const std::atomic_size_t& counter);
+        friend void _InternalWakeHelpers(ActorScheduler* scheduler);
+
+        void WakeMainThread();
+
+        /// @brief Marks count messages as handled
+        void FinishMessages(size_t count);
+
+        /// @brief Makes next the current registry. Must be called with lock
+        /// held
+        void PublishRegistry(std::unique_ptr<_InternalActorRegistry> next);
+
+        /// @brief Publishes a copy of the registry with pool added. Must be
+        /// called with lock held
+        void PublishRoute(size_t slot, std::unique_ptr<_InternalActorPool> pool);
+
+        /// @brief Publishes a copy of the registry with subscriptions added
+        /// to topic. Actors already subscribed are skipped. Must be called
+        /// with lock held
+        void PublishTopic(size_t topic, const std::vector<_InternalSubscription>& subscriptions);
 
         template <typename T>
-        void Register() {
+        void AddActor(size_t instances, RoutingPolicy policy) {
             static_assert(std::is_base_of_v<_InternalActorBase, T>);
 
             using Type = T::MessageType;
 
-            auto index = std::type_index(typeid(Type));
+            static_assert(std::is_base_of_v<_InternalMailboxActor<Type, typename T::Payload>, T>);
+
+            if (instances == 0) engine::Critical("Cannot register Actor {} with no instances", typeid(T).name());
+
+            if (policy == RoutingPolicy::KeyHash && !ShardedMessage<Type>)
+                engine::Critical("Actor {} uses RoutingPolicy::KeyHash but its message has no ShardKey()", typeid(T).name());
+
+            auto slot = _InternalMessageSlot::Get<Type>();
 
             lock.lock();
 
-            if (actors.find(index) != actors.end()) {
+            auto current = registry.load();
+
+            if (slot < current->routes.size() && current->routes[slot]) {
                 lock.unlock();
 
                 engine::Critical("Cannot register Actor {} more than once", typeid(T).name());
             }
 
-            auto actor = ActorPtr(new T);
-            bool is_main = actor->MainThreadOnly();
+            std::vector<std::unique_ptr<_InternalActorBase>> actors;
+            for (size_t i = 0; i < instances; i++) {
+                auto actor = std::unique_ptr<_InternalActorBase>(new T);
+                actor->execution = actor->GetExecutionClass();
+                if (actor->execution == ExecutionClass::Blocking && settings.blocking_threads == 0) actor->execution = ExecutionClass::Compute;
+                actor->priority = actor->GetPriority();
+                actor->next_lane = actor->priority;
+                actor->mailbox_settings = actor->GetMailboxSettings();
+                actor->stores_values = !std::is_same_v<typename T::Payload, MessagePtr<Type>>;
+
+                actors.push_back(std::move(actor));
+            }
+
+            if (actors.front()->mailbox_settings.coalesce && !_InternalHasCoalesceKey<Type>)
+                engine::Warning("Actor {} asks for a coalescing mailbox but its message has no CoalesceKey()", typeid(T).name());
+
+            PublishRoute(slot, std::make_unique<_InternalActorPool>(std::move(actors), policy));
 
-            actors[index] = actor;
-            actors_is_main[index] = is_main;
             lock.unlock();
         }
 
+    public:
+        ~ActorScheduler();
+
+        /// @brief Registers an actor. This has to happen before Seal
+        /// @param instances How many copies of the actor to create. Each one
+        /// runs independently, so stateless or partitioned handlers scale
+        /// across threads
+        /// @param policy How a message picks an instance
+        template <typename T>
+        void Register(size_t instances = 1, RoutingPolicy policy = RoutingPolicy::RoundRobin) {
+            if (sealed) {
+                engine::Critical("Cannot register Actor {} after the actor registry is sealed. Use RegisterLate", typeid(T).name());
+            }
+
+            AddActor<T>(instances, policy);
+        }
+
+        /// @brief Registers an actor after Seal. Senders keep using the old
+        /// routing table until the new one is published, and the old one
+        /// stays alive for any sender still reading it
         template <typename T>
-        bool SendMessage(std::unique_ptr<T>&& msg) {
-            auto index = std::type_index(typeid(T));
+        void RegisterLate(size_t instances = 1, RoutingPolicy policy = RoutingPolicy::RoundRobin) {
+            AddActor<T>(instances, policy);
+        }
+
+        /// @brief Marks the end of normal registration. The Application calls
+        /// this after OnPostActorSchedulerSetup
+        void Seal();
+
+        /// @brief Subscribes every instance of the registered actor A to
+        /// events of type E. This can be called at any time
+        template <typename E, typename A>
+        void Subscribe() {
+            static_assert(std::is_base_of_v<_InternalActorBase, A>);
+            static_assert(std::is_base_of_v<Subscriber<E>, A>);
+
+            auto slot = _InternalMessageSlot::Get<typename A::MessageType>();
 
             lock.lock();
-            if (actors.find(index) == actors.end()) {
+
+            auto current = registry.load();
+
+            if (slot >= current->routes.size() || !current->routes[slot] || typeid(*current->routes[slot]->Front()) != typeid(A)) {
                 lock.unlock();
-                return false;
+
+                engine::Critical("Actor {} has to be registered before it can subscribe", typeid(A).name());
             }
 
-            auto actor = actors[index];
-            auto is_main = actors_is_main[index];
+            auto pool = current->routes[slot];
+
+            std::vector<_InternalSubscription> subscriptions;
+            for (size_t i = 0; i < pool->Size(); i++) subscriptions.push_back({pool->Get(i), &_InternalHandleEvent<E, A>});
+
+            PublishTopic(_InternalMessageSlot::Get<E>(), subscriptions);
 
             lock.unlock();
+        }
 
-            auto typed_actor = dynamic_cast<Actor<T>*>(actor.get());
+    private:
+        /// @brief The subscribers of E. Registries are kept until the
+        /// scheduler is destroyed, so the list stays valid
+        /// @return The list, or \c nullptr if nothing is subscribed
+        template <typename E>
+        const std::vector<_InternalSubscription>* GetSubscribers() const {
+            auto slot = _InternalMessageSlot::Get<E>();
 
-            if (!typed_actor) return false;
+            auto routes = registry.load(std::memory_order_acquire);
 
-            typed_actor->AcceptMessage(std::move(msg));
+            if (slot >= routes->topics.size() || routes->topics[slot].empty()) return nullptr;
 
-            lock.lock();
+            return &routes->topics[slot];
+        }
 
-            if (is_main) main_to_do.push_back(actor);
-            else to_do.push_back(actor);
+        /// @brief Picks the instance of the pool registered for T that gets
+        /// msg
+        /// @return The actor, or \c nullptr if nothing handles T
+        template <typename T>
+        _InternalActorBase* Route(const T& msg) {
+            auto slot = _InternalMessageSlot::Get<T>();
 
-            lock.unlock();
+            auto routes = registry.load(std::memory_order_acquire);
+
+            if (slot >= routes->routes.size() || !routes->routes[slot]) return nullptr;
+
+            auto pool = routes->routes[slot];
+
+            if (pool->Size() == 1) return pool->Front();
+
+            if constexpr (ShardedMessage<T>) {
+                if (pool->GetPolicy() == RoutingPolicy::KeyHash) {
+                    auto key = msg.ShardKey();
+                    return pool->PickByHash(std::hash<decltype(key)>{}(key));
+                }
+            }
+
+            return pool->Pick();
+        }
+
+        /// @brief Queues msg in the mailbox of actor
+        template <typename T, typename Payload>
+        bool Deliver(_InternalActorBase* actor, Payload&& msg, const SendOptions& options) {
+            // Register only stores actors derived from the matching mailbox
+            // in T's slot, and stores_values tells the two kinds apart
+            auto typed_actor = static_cast<_InternalMailboxActor<T, Payload>*>(actor);
+
+            auto deadline = options.deadline.value_or(std::chrono::steady_clock::time_point::max());
+
+            std::optional<size_t> coalesce_key;
+
+            if constexpr (_InternalHasCoalesceKey<T>) {
+                if (actor->mailbox_settings.coalesce) coalesce_key = _InternalCoalesceKey(msg);
+            }
+
+            auto admission = Admit(actor);
+
+            if (admission == Admission::Rejected) return false;
+            if (admission == Admission::Dropped) return true;
+
+            auto group = MessageGroup::Current();
+            if (group) group->pending++;
+
+            Prioritize(actor, options);
+
+            if (admission == Admission::Replace) {
+                if (typed_actor->ReplaceOldest(std::move(msg), deadline, group, coalesce_key)) return true;
+
+                // The mailbox drained meanwhile, so there is room after all
+                actor->AddQueued();
+            }
+
+            typed_actor->AcceptMessage(std::move(msg), deadline, group, coalesce_key);
+
+            in_flight++;
+
+            if (actor->pending_messages.fetch_add(1) == 0) Schedule(actor);
+
+            TrackDeadline(actor, options);
             return true;
         }
 
+    public:
+        template <typename T>
+        bool SendMessage(MessagePtr<T>&& msg, const SendOptions& options = {}) {
+            auto actor = Route(*msg);
+            if (!actor) return false;
+
+            if constexpr (std::is_move_constructible_v<T>) {
+                if (actor->stores_values) return Deliver<T, T>(actor, T(std::move(*msg)), options);
+            }
+
+            return Deliver<T, MessagePtr<T>>(actor, std::move(msg), options);
+        }
+
+        template <typename T>
+        inline bool SendMessage(std::unique_ptr<T>&& msg, const SendOptions& options = {}) {
+            message_pool_stats.unpooled_messages++;
+            return SendMessage(MessagePtr<T>(std::move(msg)), options);
+        }
+
+        template <typename As, typename Type>
+        inline bool SendMessageAs(MessagePtr<Type>&& msg, const SendOptions& options = {}) {
+            MessagePtr<As> as(static_cast<As*>(msg.get()), MessageDeleter<As>(msg.get_deleter()));
+            msg.release();
+            return SendMessage(std::move(as), options);
+        }
+
         template <typename As, typename Type>
-        inline bool SendMessageAs(std::unique_ptr<Type>&& msg) {
-            std::unique_ptr<As> as(static_cast<As*>(msg.release()));
-            return SendMessage(std::move(as));
+        inline bool SendMessageAs(std::unique_ptr<Type>&& msg, const SendOptions& options = {}) {
+            message_pool_stats.unpooled_messages++;
+            return SendMessageAs<As, Type>(MessagePtr<Type>(std::move(msg)), options);
         }
 
+        /// @brief Sends msg, stored by value if its actor keeps messages by
+        /// value and in pooled memory otherwise
         template <typename T>
-        inline bool EmplaceMessage(T&& msg) {
+        bool EmplaceMessage(T&& msg, const SendOptions& options = {}) {
             static_assert(std::is_move_constructible_v<T>);
-            return SendMessage(std::unique_ptr<T>(new T(std::move(msg))));
+
+            auto actor = Route(msg);
+            if (!actor) return false;
+
+            if (actor->stores_values) return Deliver<T, T>(actor, std::move(msg), options);
+
+            return Deliver<T, MessagePtr<T>>(actor, MakeMessage<T>(std::move(msg)), options);
+        }
+
+        /// @brief Sends msg to the actor for As. As is either a base class of
+        /// Type or a type constructible from it, such as the variant of a
+        /// VariantActor
+        template <typename As, typename Type>
+        inline bool EmplaceMessageAs(Type&& msg, const SendOptions& options = {}) {
+            static_assert(std::is_move_constructible_v<Type>);
+
+            if constexpr (std::is_same_v<As, Type>) return EmplaceMessage<As>(std::move(msg), options);
+            else if constexpr (std::is_base_of_v<As, Type>) return SendMessageAs<As, Type>(MakeMessage<Type>(std::move(msg)), options);
+            else return EmplaceMessage<As>(As(std::move(msg)), options);
+        }
+
+        /// @brief Sends event to every actor subscribed to E. They all share
+        /// one immutable copy and handle it in parallel
+        /// @return The number of subscribers it was sent to
+        template <typename E>
+        size_t Publish(E&& event, const SendOptions& options = {}) {
+            static_assert(std::is_move_constructible_v<E>);
+
+            // Nothing is allocated for a topic nobody listens to
+            if (!GetSubscribers<E>()) return 0;
+
+            return PublishShared<E>(std::make_shared<const E>(std::move(event)), options);
+        }
+
+        /// @brief Publish for an event that is already shared
+        template <typename E>
+        size_t PublishShared(std::shared_ptr<const E> event, const SendOptions& options = {}) {
+            auto subscribers = GetSubscribers<E>();
+            if (!subscribers) return 0;
+
+            std::shared_ptr<const void> shared = std::move(event);
+
+            for (auto& subscription : *subscribers) PostEvent(subscription, shared, options);
+
+            return subscribers->size();
         }
 
+        /// @brief Sends msg to the actor for As after delay. Timers have a
+        /// resolution of 1 ms and never fire early
         template <typename As, typename Type>
-        inline bool EmplaceMessageAs(Type&& msg) {
+        TimerHandle SendAfterAs(std::chrono::steady_clock::duration delay, Type&& msg, const SendOptions& options = {}) {
             static_assert(std::is_move_constructible_v<Type>);
-            return SendMessageAs<As, Type>(std::unique_ptr<Type>(new Type(std::move(msg))));
+
+            auto timer = MessagePool<_InternalSendTimer<As, Type>>::New(std::move(msg), options);
+            return AddTimer(timer, delay, std::chrono::steady_clock::duration::zero());
+        }
+
+        template <typename T>
+        inline TimerHandle SendAfter(std::chrono::steady_clock::duration delay, T&& msg, const SendOptions& options = {}) {
+            return SendAfterAs<T, T>(delay, std::move(msg), options);
+        }
+
+        /// @brief Sends a copy of msg to the actor for As every period, until
+        /// the timer is cancelled. Periods missed while the threads were busy
+        /// are skipped rather than sent in a burst
+        template <typename As, typename Type>
+        TimerHandle SendEveryAs(std::chrono::steady_clock::duration period, Type&& msg, const SendOptions& options = {}) {
+            static_assert(std::is_copy_constructible_v<Type>);
+
+            auto timer = MessagePool<_InternalSendTimer<As, Type>>::New(std::move(msg), options);
+            return AddTimer(timer, period, period);
+        }
+
+        template <typename T>
+        inline TimerHandle SendEvery(std::chrono::steady_clock::duration period, T&& msg, const SendOptions& options = {}) {
+            return SendEveryAs<T, T>(period, std::move(msg), options);
+        }
+
+        /// @brief Stops a timer from SendAfter or SendEvery
+        /// @return \c false if the timer already fired or was cancelled
+        bool Cancel(TimerHandle handle);
+
+        /// @brief Sends msg to the actor for T and returns a Future for its
+        /// reply. Type needs a Promise<R> member named reply, which the
+        /// handler Sets. The Future reports a broken promise if the message
+        /// could not be sent or was dropped without a reply
+        template <typename T, typename R, typename Type>
+        Future<R> Ask(Type&& msg, const SendOptions& options = {}) {
+            static_assert(std::is_same_v<decltype(msg.reply), Promise<R>>, "Asked messages need a Promise<R> member named reply");
+
+            auto [promise, future] = Future<R>::Make(this);
+            msg.reply = std::move(promise);
+
+            EmplaceMessageAs<T, Type>(std::move(msg), options);
+
+            return std::move(future);
         }
 
+        /// @brief Runs messages on the calling (main) thread until every sent
+        /// message, including ones sent while handling, has been handled. When
+        /// there is nothing the main thread can run it sleeps instead of
+        /// spinning
         void ProcessAllMessages();
 
-        inline static auto Create(size_t thread_count) {
-            return std::unique_ptr<ActorScheduler>(new ActorScheduler(thread_count));
+        /// @brief Makes messages sent from this thread join group until the
+        /// returned scope is destroyed
+        [[nodiscard]] MessageGroup::Scope Track(MessageGroup& group);
+
+        /// @brief Runs messages on the calling (main) thread, including general
+        /// work and work stolen from the workers, until every message of group
+        /// has been handled. Unrelated messages may still be in flight after
+        void Wait(const MessageGroup& group);
+
+        /// @brief Creates a scheduler. The calling thread becomes its main
+        /// thread, the only one that runs ExecutionClass::MainThread actors.
+        /// With ThreadTopology::pin_threads it is pinned to the first core
+        inline static auto Create(size_t thread_count, const ActorSchedulerSettings& settings = {}) {
+            return std::unique_ptr<ActorScheduler>(new ActorScheduler(thread_count, settings));
         }
     };
 
     extern std::unique_ptr<ActorScheduler> API actor_scheduler;
 
+    /// @brief Counts work done off the actors, such as file I/O, as a message
+    /// in flight. ProcessAllMessages and the group current when it started
+    /// wait for it, and so does the scheduler before it is destroyed
+    class API _InternalExternalWork {
+    private:
+        ActorScheduler* scheduler = nullptr;
+        MessageGroup* group = nullptr;
+
+    public:
+        _InternalExternalWork() = default;
+
+        /// @brief Starts counting on the calling thread's scheduler, or
+        /// actor_scheduler on other threads, and its current group
+        static _InternalExternalWork Start();
+
+        _InternalExternalWork(_InternalExternalWork&& other)
+            : scheduler{std::exchange(other.scheduler, nullptr)}, group{std::exchange(other.group, nullptr)} {}
+
+        _InternalExternalWork& operator=(_InternalExternalWork&& other) {
+            if (this != &other) {
+                Finish();
+
+                scheduler = std::exchange(other.scheduler, nullptr);
+                group = std::exchange(other.group, nullptr);
+            }
+
+            return *this;
+        }
+
+        ~_InternalExternalWork() { Finish(); }
+
+        /// @brief Calls report with the group of the work current, so the
+        /// messages it sends join the group, then finishes the work
+        template <typename F>
+        void Finish(F&& report) {
+            auto previous = MessageGroup::Swap(group);
+            report();
+            MessageGroup::Swap(previous);
+
+            Finish();
+        }
+
+        /// @brief Marks the work as done. Does nothing if it already is. The
+        /// scheduler is not touched after the work stops counting in
+        /// external_work
+        void Finish();
+    };
+
+    template <typename As, typename Type>
+    struct _InternalSendTimer : public _InternalTimer {
+        Type msg;
+        SendOptions options;
+
+        _InternalSendTimer(Type&& msg, const SendOptions& options) : msg{std::move(msg)}, options{options} {
+            fire = &Fire;
+            destroy = &Destroy;
+        }
+
+        static void Fire(_InternalTimer* timer, ActorScheduler* scheduler) {
+            auto self = static_cast<_InternalSendTimer*>(timer);
+
+            if constexpr (std::is_copy_constructible_v<Type>) {
+                if (self->period != 0) {
+                    scheduler->EmplaceMessageAs<As, Type>(Type(self->msg), self->options);
+                    return;
+                }
+            }
+
+            scheduler->EmplaceMessageAs<As, Type>(std::move(self->msg), self->options);
+        }
+
+        static void Destroy(_InternalTimer* timer) {
+            MessagePool<_InternalSendTimer>::Delete(static_cast<_InternalSendTimer*>(timer));
+        }
+    };
+
+    template <typename R>
+    template <typename As>
+    void Future<R>::SendTo(_InternalAskState<R>* state) {
+        // Then handed over the reference of the future, so drop it once sent
+        if (!state->value) engine::Error("A promise was broken, so the reply for {} was not sent", typeid(As).name());
+        else state->scheduler->template EmplaceMessage<As>(As(std::move(*state->value)));
+
+        state->Release();
+    }
+
 }
 
 #endif
\ No newline at end of file
@@ -1,16 +1,41 @@
 #ifndef CROW_APPLICATION_HPP
 #define CROW_APPLICATION_HPP
 
+#include <chrono>
 #include <memory>
 
 #include "Crow.hpp"
+#include "Actor.hpp"
 
 namespace crow {
 
+    /// @brief How the Application paces its run loop
+    struct API RunLoopSettings {
+        /// @brief Frames per second to aim for. 0 runs frames back to back
+        double target_fps = 0;
+
+        /// @brief Seconds simulated by each OnFixedUpdate. 0 disables fixed
+        /// updates
+        double fixed_timestep = 0;
+
+        /// @brief The most fixed updates in one frame. Time beyond that is
+        /// dropped, so a slow frame cannot make the next one slower
+        size_t max_fixed_steps = 5;
+
+        /// @brief How long before a frame deadline to stop sleeping and spin
+        /// instead, since sleeping can overshoot
+        std::chrono::microseconds spin_threshold = std::chrono::microseconds(1500);
+    };
+
     class API Application {
     private:
         bool running = true;
 
+        double interpolation_alpha = 0;
+
+        /// @brief Sleeps, then spins, until deadline
+        void WaitUntil(std::chrono::steady_clock::time_point deadline, std::chrono::microseconds spin_threshold) const;
+
     public:
         Application() = default;
         virtual ~Application() = default;
@@ -18,12 +43,29 @@ namespace crow {
     protected:
         inline void Exit() { running = false; }
 
+        /// @brief How far the time since the last fixed update is into the
+        /// next one, from 0 to 1. Use it in OnUpdate to interpolate between
+        /// the last two simulated states
+        inline double GetInterpolationAlpha() const { return interpolation_alpha; }
+
         virtual size_t GetThreadCount() const;
 
+        virtual ActorSchedulerSettings GetActorSchedulerSettings() const;
+
+        virtual RunLoopSettings GetRunLoopSettings() const;
+
         virtual void OnPreActorSchedulerSetup() = 0;
         virtual void OnPostActorSchedulerSetup() = 0;
         virtual void OnRegisterActors() = 0;
-        virtual void OnUpdate() = 0;
+        /// @brief Called once per frame
+        /// @param delta Seconds since the last frame started
+        virtual void OnUpdate(double delta) = 0;
+
+        /// @brief Called zero or more times per frame, before OnUpdate, with
+        /// a constant timestep. Messages sent here are handled before the next
+        /// step, so the simulation is deterministic
+        virtual void OnFixedUpdate([[maybe_unused]] double timestep) {}
+
         virtual void OnPreActorSchedulerCleanup() = 0;
         virtual void OnPostActorSchedulerCleanup() = 0;
     
@@ -0,0 +1,105 @@
+#ifndef CROW_FILE_HPP
+#define CROW_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "Actor.hpp"
+
+namespace crow {
+
+    /// @brief The outcome of a file request
+    struct API FileResult {
+        std::string path;
+
+        /// @brief The bytes read. Empty for writes
+        std::vector<std::byte> data;
+
+        /// @brief How many bytes were read or written
+        size_t bytes = 0;
+
+        /// @brief 0 on success, otherwise an errno code
+        int error = 0;
+
+        inline bool Ok() const { return error == 0; }
+    };
+
+    /// @brief Reads a file. Send it with Ask<FileMessage, FileResult>, then
+    /// co_await the Future in a Task or hand the result to an actor with Then
+    struct API FileRead {
+        static constexpr size_t whole_file = static_cast<size_t>(-1);
+
+        std::string path;
+
+        uint64_t offset = 0;
+
+        /// @brief The most bytes to read. By default the rest of the file
+        size_t size = whole_file;
+
+        /// @brief Set when the message is sent with Ask
+        Promise<FileResult> reply;
+
+        FileRead() = default;
+
+        FileRead(std::string path, uint64_t offset = 0, size_t size = whole_file) : path{std::move(path)}, offset{offset}, size{size} {}
+    };
+
+    /// @brief Writes data to a file, creating the file if needed. Send it like
+    /// FileRead
+    struct API FileWrite {
+        std::string path;
+
+        std::vector<std::byte> data;
+
+        uint64_t offset = 0;
+
+        /// @brief Replaces the whole file instead of writing into it
+        bool truncate = true;
+
+        /// @brief Set when the message is sent with Ask
+        Promise<FileResult> reply;
+
+        FileWrite() = default;
+
+        FileWrite(std::string path, std::vector<std::byte> data, uint64_t offset = 0, bool truncate = true) : path{std::move(path)}, data{std::move(data)}, offset{offset}, truncate{truncate} {}
+    };
+
+    /// @brief Every message the FileSystem handles
+    using FileMessage = std::variant<FileRead, FileWrite>;
+
+    class _InternalFileBackend;
+
+    /// @brief Reads and writes files without blocking the compute threads.
+    /// On Linux the transfers go through io_uring, so many requests are in
+    /// flight at once. Elsewhere, or when io_uring is not available, a small
+    /// thread pool does them. Results are sent back through the promise of
+    /// each request
+    class API FileSystem : public VariantActor<FileRead, FileWrite> {
+    private:
+        /// @brief Created by the first request, so registering the actor
+        /// starts no threads
+        std::unique_ptr<_InternalFileBackend> backend;
+
+        _InternalFileBackend& GetBackend();
+
+    public:
+        FileSystem();
+
+        ~FileSystem();
+
+        void HandleMessage(FileRead&& msg) override;
+        void HandleMessage(FileWrite&& msg) override;
+
+        /// @brief Opening a file can block, so requests are handled in the
+        /// blocking pool
+        ExecutionClass GetExecutionClass() const override { return ExecutionClass::Blocking; }
+    };
+
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,224 @@
+#ifndef CROW_FUTURE_HPP
+#define CROW_FUTURE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <thread>
+#include <utility>
+
+#include "Crow.hpp"
+#include "MessagePool.hpp"
+
+namespace crow {
+
+    class ActorScheduler;
+
+    template <typename R>
+    class _InternalFutureAwaiter;
+
+    /// @brief Runs work on the calling thread until counter is 0
+    API void _InternalHelpUntil(ActorScheduler* scheduler, const std::atomic_size_t& counter);
+
+    /// @brief Wakes a thread blocked in _InternalHelpUntil
+    API void _InternalWakeHelpers(ActorScheduler* scheduler);
+
+    /// @brief The state a Promise and a Future share. It lives in a
+    /// MessagePool, so asking does not allocate once the pool is warm
+    template <typename R>
+    class _InternalAskState {
+    public:
+        enum Status : uint8_t { Empty, Continued, Ready };
+
+        using Continuation = void (*)(_InternalAskState*);
+
+        /// @brief One reference for the Promise and one for the Future
+        std::atomic<uint8_t> refs = 2;
+
+        std::atomic<uint8_t> status = Empty;
+
+        /// @brief 1 until the promise is kept or broken, for waiting
+        std::atomic_size_t unready = 1;
+
+        std::optional<R> value;
+
+        /// @brief Runs once when the state becomes ready, if set
+        Continuation continuation = nullptr;
+
+        /// @brief Data for the continuation
+        void* context = nullptr;
+
+        ActorScheduler* scheduler = nullptr;
+
+        void Release() {
+            if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) MessagePool<_InternalAskState>::Delete(this);
+        }
+
+        /// @brief Marks the state ready. value must be set first, unless the
+        /// promise is broken
+        void Complete() {
+            auto previous = status.exchange(Ready, std::memory_order_acq_rel);
+            if (previous == Continued) continuation(this);
+
+            unready = 0;
+            if (scheduler) _InternalWakeHelpers(scheduler);
+        }
+
+        /// @brief Runs continuation once the state is ready, now if it already
+        /// is
+        void Continue(Continuation next, void* data) {
+            continuation = next;
+            context = data;
+
+            uint8_t expected = Empty;
+            if (!status.compare_exchange_strong(expected, Continued, std::memory_order_acq_rel))
+                continuation(this);
+        }
+    };
+
+    /// @brief The sending side of an asked value. Put one in a message as a
+    /// member named reply and the handler Sets it
+    template <typename R>
+    class Promise {
+    private:
+        _InternalAskState<R>* state = nullptr;
+
+    public:
+        Promise() = default;
+
+        explicit Promise(_InternalAskState<R>* state) : state{state} {}
+
+        /// @brief Dont allow copy
+        Promise(const Promise&) = delete;
+
+        /// @brief Dont allow copy
+        Promise& operator=(const Promise&) = delete;
+
+        Promise(Promise&& other) : state{std::exchange(other.state, nullptr)} {}
+
+        Promise& operator=(Promise&& other) {
+            if (this != &other) {
+                Break();
+                state = std::exchange(other.state, nullptr);
+            }
+
+            return *this;
+        }
+
+        /// @brief A promise dropped without a value breaks it
+        ~Promise() { Break(); }
+
+        /// @brief Returns if anyone is waiting for a value
+        inline bool IsValid() const { return state != nullptr; }
+
+        /// @brief Hands the value to the Future. Does nothing if the promise
+        /// is empty or already kept
+        void Set(R value) {
+            if (!state) return;
+
+            state->value.emplace(std::move(value));
+            state->Complete();
+
+            std::exchange(state, nullptr)->Release();
+        }
+
+    private:
+        void Break() {
+            if (!state) return;
+
+            state->Complete();
+
+            std::exchange(state, nullptr)->Release();
+        }
+    };
+
+    /// @brief The receiving side of an asked value
+    template <typename R>
+    class Future {
+        template <typename U>
+        friend class _InternalFutureAwaiter;
+
+    private:
+        _InternalAskState<R>* state = nullptr;
+
+        template <typename As>
+        static void SendTo(_InternalAskState<R>* state);
+
+    public:
+        Future() = default;
+
+        explicit Future(_InternalAskState<R>* state) : state{state} {}
+
+        /// @brief Dont allow copy
+        Future(const Future&) = delete;
+
+        /// @brief Dont allow copy
+        Future& operator=(const Future&) = delete;
+
+        Future(Future&& other) : state{std::exchange(other.state, nullptr)} {}
+
+        Future& operator=(Future&& other) {
+            if (this != &other) {
+                if (state) state->Release();
+                state = std::exchange(other.state, nullptr);
+            }
+
+            return *this;
+        }
+
+        ~Future() {
+            if (state) state->Release();
+        }
+
+        /// @brief Returns if the promise was kept or broken
+        inline bool IsReady() const {
+            return state && state->status.load(std::memory_order_acquire) == _InternalAskState<R>::Ready;
+        }
+
+        /// @brief Blocks until the future is ready. The calling thread runs
+        /// other messages meanwhile, so the reply can be handled even on a
+        /// single thread
+        void Wait() {
+            if (!state || IsReady()) return;
+
+            if (state->scheduler) _InternalHelpUntil(state->scheduler, state->unready);
+            else {
+                while (state->unready.load() != 0) std::this_thread::yield();
+            }
+        }
+
+        /// @brief Waits for the value and takes it
+        /// @return The value, or \c std::nullopt if the promise was broken
+        std::optional<R> Get() {
+            Wait();
+
+            if (!state) return std::nullopt;
+
+            auto value = std::move(state->value);
+            std::exchange(state, nullptr)->Release();
+
+            return value;
+        }
+
+        /// @brief Sends the value as a message to the actor for As once it is
+        /// ready, instead of waiting for it. This consumes the future
+        template <typename As>
+        void Then() {
+            if (!state) return;
+
+            // The continuation takes over this future's reference
+            std::exchange(state, nullptr)->Continue(&SendTo<As>, nullptr);
+        }
+
+        /// @brief Makes a connected Promise and Future
+        static std::pair<Promise<R>, Future<R>> Make(ActorScheduler* scheduler) {
+            auto state = MessagePool<_InternalAskState<R>>::New();
+            state->scheduler = scheduler;
+
+            return {Promise<R>(state), Future<R>(state)};
+        }
+    };
+
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,108 @@
+#ifndef CROW_MPSC_QUEUE_HPP
+#define CROW_MPSC_QUEUE_HPP
+
+#include <atomic>
+#include <thread>
+#include <type_traits>
+
+#include "Crow.hpp"
+
+namespace crow {
+
+    /// @brief The link every MPSCQueue element has to inherit from
+    struct API MPSCQueueNode {
+        std::atomic<MPSCQueueNode*> next = nullptr;
+    };
+
+    /// @brief An intrusive multi producer, single consumer queue. Pushing is
+    /// wait free and popping is O(1). The queue does not own its elements
+    template <typename T>
+    class MPSCQueue {
+        static_assert(std::is_base_of_v<MPSCQueueNode, T>);
+
+    private:
+        /// @brief The last pushed node. Producers swap themselves in here
+        alignas(64) std::atomic<MPSCQueueNode*> head;
+
+        /// @brief The next node to pop. Only touched by the consumer
+        alignas(64) MPSCQueueNode* tail;
+
+        /// @brief Keeps the list non empty so producers never touch tail
+        MPSCQueueNode stub;
+
+        void PushNode(MPSCQueueNode* node) {
+            node->next.store(nullptr, std::memory_order_relaxed);
+            auto prev = head.exchange(node, std::memory_order_acq_rel);
+            prev->next.store(node, std::memory_order_release);
+        }
+
+        /// @brief A producer has swapped itself into head but not linked the
+        /// previous node to itself yet. It is guaranteed to, so wait for it
+        MPSCQueueNode* WaitForLink(MPSCQueueNode* node) {
+            MPSCQueueNode* next;
+            while (!(next = node->next.load(std::memory_order_acquire)))
+                std::this_thread::yield();
+
+            return next;
+        }
+
+    public:
+        MPSCQueue() : head{&stub}, tail{&stub} {}
+
+        /// @brief Dont allow copy
+        MPSCQueue(const MPSCQueue&) = delete;
+
+        /// @brief Dont allow copy
+        MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+        /// @brief Dont allow move
+        MPSCQueue(MPSCQueue&&) = delete;
+
+        /// @brief Dont allow move
+        MPSCQueue& operator=(MPSCQueue&&) = delete;
+
+        /// @brief Adds a node to the queue. This can be called from any thread
+        /// @param node The node. It must stay alive until it is popped
+        inline void Push(T* node) { PushNode(node); }
+
+        /// @brief Removes the oldest node. Only one thread may pop at a time
+        /// @return The node, or \c nullptr if the queue is empty
+        T* Pop() {
+            auto node = tail;
+            auto next = node->next.load(std::memory_order_acquire);
+
+            if (node == &stub) {
+                if (!next) {
+                    if (head.load(std::memory_order_acquire) == &stub)
+                        return nullptr;
+
+                    next = WaitForLink(node);
+                }
+
+                tail = next;
+                node = next;
+                next = next->next.load(std::memory_order_acquire);
+            }
+
+            if (next) {
+                tail = next;
+                return static_cast<T*>(node);
+            }
+
+            if (node != head.load(std::memory_order_acquire)) {
+                tail = WaitForLink(node);
+                return static_cast<T*>(node);
+            }
+
+            // node is the only element. Put the stub behind it so it can be
+            // unlinked without racing producers
+            PushNode(&stub);
+
+            tail = WaitForLink(node);
+            return static_cast<T*>(node);
+        }
+    };
+
+}
+
+#endif
\ No newline at end of file
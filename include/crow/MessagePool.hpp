@@ -0,0 +1,226 @@
+#ifndef CROW_MESSAGE_POOL_HPP
+#define CROW_MESSAGE_POOL_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "Crow.hpp"
+
+namespace crow {
+
+    /// @brief Counters shared by every MessagePool. Once messaging reaches a
+    /// steady state slab_allocations stops growing
+    struct API MessagePoolStats {
+        /// @brief The number of times a pool had to allocate memory
+        std::atomic_size_t slab_allocations = 0;
+
+        /// @brief The total bytes allocated by all pools
+        std::atomic_size_t slab_bytes = 0;
+
+        /// @brief Messages sent that were allocated by the caller instead of a
+        /// pool
+        std::atomic_size_t unpooled_messages = 0;
+    };
+
+    extern MessagePoolStats API message_pool_stats;
+
+    /// @brief A slab allocator for one type. Each thread keeps a cache of free
+    /// blocks. Blocks freed on another thread go to that thread's cache, and
+    /// caches trade blocks with a shared free list in batches
+    template <typename T>
+    class MessagePool {
+    private:
+        union Block {
+            Block* next;
+            alignas(T) unsigned char storage[sizeof(T)];
+        };
+
+        static constexpr size_t slab_blocks = 64;
+        static constexpr size_t batch_size = 32;
+        static constexpr size_t cache_limit = batch_size * 4;
+
+        struct Cache {
+            Block* free = nullptr;
+            size_t count = 0;
+
+            ~Cache() {
+                while (free) {
+                    auto next = free->next;
+                    PushShared(free, free);
+                    free = next;
+                }
+            }
+        };
+
+        // The shared list has no destructor on purpose. Blocks may be freed
+        // during static destruction, so it has to outlive everything. Slabs
+        // are never given back to the system
+        static inline std::atomic_flag shared_lock;
+        static inline Block* shared_free = nullptr;
+
+        static Cache& GetCache() {
+            thread_local Cache cache;
+            return cache;
+        }
+
+        static void LockShared() {
+            while (shared_lock.test_and_set(std::memory_order_acquire))
+                std::this_thread::yield();
+        }
+
+        static void UnlockShared() {
+            shared_lock.clear(std::memory_order_release);
+        }
+
+        /// @brief Pushes the chain first..last onto the shared list
+        static void PushShared(Block* first, Block* last) {
+            LockShared();
+            last->next = shared_free;
+            shared_free = first;
+            UnlockShared();
+        }
+
+        /// @brief Moves up to batch_size blocks from the shared list into the
+        /// cache, or allocates a new slab if the shared list is empty
+        static void Refill(Cache& cache) {
+            LockShared();
+            while (shared_free && cache.count < batch_size) {
+                auto block = shared_free;
+                shared_free = block->next;
+
+                block->next = cache.free;
+                cache.free = block;
+                cache.count++;
+            }
+            UnlockShared();
+
+            if (cache.count != 0) return;
+
+            // T may need more alignment than plain operator new guarantees
+            auto slab = static_cast<Block*>(::operator new(sizeof(Block) * slab_blocks, std::align_val_t{alignof(Block)}));
+
+            message_pool_stats.slab_allocations++;
+            message_pool_stats.slab_bytes += sizeof(Block) * slab_blocks;
+
+            for (size_t i = 0; i < slab_blocks; i++) {
+                slab[i].next = cache.free;
+                cache.free = &slab[i];
+            }
+
+            cache.count = slab_blocks;
+        }
+
+    public:
+        /// @brief Gets uninitialized memory for one T
+        static void* Acquire() {
+            auto& cache = GetCache();
+
+            if (!cache.free) Refill(cache);
+
+            auto block = cache.free;
+            cache.free = block->next;
+            cache.count--;
+
+            return block->storage;
+        }
+
+        /// @brief Gives back memory from Acquire. This can be called from any
+        /// thread
+        static void Release(void* memory) {
+            auto& cache = GetCache();
+
+            auto block = reinterpret_cast<Block*>(memory);
+            block->next = cache.free;
+            cache.free = block;
+            cache.count++;
+
+            if (cache.count <= cache_limit) return;
+
+            // Hand a batch to the shared list so the threads that send can
+            // reuse what the threads that handle free
+            auto first = cache.free;
+            auto last = first;
+            for (size_t i = 1; i < batch_size; i++) last = last->next;
+
+            cache.free = last->next;
+            cache.count -= batch_size;
+
+            PushShared(first, last);
+        }
+
+        /// @brief Constructs a T in pooled memory
+        template <typename... Args>
+        static T* New(Args&&... args) {
+            auto memory = Acquire();
+
+            try {
+                return new (memory) T(std::forward<Args>(args)...);
+            }
+            catch (...) {
+                Release(memory);
+                throw;
+            }
+        }
+
+        /// @brief Destroys a T made by New
+        static void Delete(T* object) {
+            object->~T();
+            Release(object);
+        }
+    };
+
+    /// @brief Deletes a message either with delete or by giving it back to the
+    /// MessagePool it came from
+    template <typename T>
+    struct MessageDeleter {
+        /// @brief The pool's Release, or \c nullptr if the message was made
+        /// with new
+        void (*release)(void*) = nullptr;
+
+        /// @brief The pooled memory. This can differ from the message pointer
+        /// when the message was converted to a base class
+        void* memory = nullptr;
+
+        constexpr MessageDeleter() = default;
+
+        constexpr MessageDeleter(void (*release)(void*), void* memory) : release{release}, memory{memory} {}
+
+        template <typename U>
+        requires std::is_convertible_v<U*, T*>
+        constexpr MessageDeleter(const std::default_delete<U>&) {}
+
+        template <typename U>
+        requires std::is_convertible_v<U*, T*>
+        constexpr MessageDeleter(const MessageDeleter<U>& other) : release{other.release}, memory{other.memory} {}
+
+        void operator()(T* msg) const {
+            if (!release) {
+                delete msg;
+                return;
+            }
+
+            msg->~T();
+            release(memory);
+        }
+    };
+
+    /// @brief An owning pointer to a message which may live in a MessagePool.
+    /// A std::unique_ptr converts to this
+    template <typename T>
+    using MessagePtr = std::unique_ptr<T, MessageDeleter<T>>;
+
+    /// @brief Creates a message in its type's MessagePool
+    template <typename T, typename... Args>
+    inline MessagePtr<T> MakeMessage(Args&&... args) {
+        auto msg = MessagePool<T>::New(std::forward<Args>(args)...);
+        return MessagePtr<T>(msg, MessageDeleter<T>(&MessagePool<T>::Release, msg));
+    }
+
+}
+
+#endif
\ No newline at end of file
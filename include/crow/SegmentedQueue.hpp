@@ -0,0 +1,212 @@
+#ifndef CROW_SEGMENTED_QUEUE_HPP
+#define CROW_SEGMENTED_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <thread>
+#include <utility>
+
+#include "Crow.hpp"
+#include "MessagePool.hpp"
+
+namespace crow {
+
+    /// @brief A multi producer, single consumer queue that stores elements by
+    /// value in fixed size segments. The consumer reads each segment front to
+    /// back, so small elements are handled from contiguous memory instead of
+    /// one node per element. Segments come from a MessagePool and are reused
+    ///
+    /// Producers Claim an element, fill it in and Publish it. The consumer
+    /// Pops the oldest element and Releases it when done
+    template <typename T, size_t SegmentSize = 32>
+    class SegmentedQueue {
+        static_assert(SegmentSize > 0);
+
+    private:
+        struct Slot {
+            // First, so an element pointer is also its slot pointer
+            alignas(T) unsigned char storage[sizeof(T)];
+
+            std::atomic_bool ready = false;
+        };
+
+        struct Segment {
+            /// @brief Producers take slots by counting up. Values past
+            /// SegmentSize mean the segment is full
+            std::atomic_size_t claimed = 0;
+
+            std::atomic<Segment*> next = nullptr;
+
+            /// @brief Links segments the consumer is done with but cannot
+            /// free yet
+            Segment* retired_next = nullptr;
+
+            Slot slots[SegmentSize];
+        };
+
+        /// @brief The segment producers claim from
+        alignas(64) std::atomic<Segment*> tail;
+
+        /// @brief Advanced by the consumer. A producer counts itself in
+        /// claiming under the parity of the epoch it saw
+        alignas(64) std::atomic_size_t epoch = 0;
+
+        /// @brief The number of producers inside Claim, by epoch parity. A
+        /// producer may still hold a segment the consumer has finished, so a
+        /// finished segment is only freed once both counts have been seen at
+        /// 0 after it was retired
+        std::atomic_size_t claiming[2] = {};
+
+        /// @brief The segment and slot to pop next. Only touched by the
+        /// consumer
+        alignas(64) Segment* head;
+        size_t head_index = 0;
+
+        /// @brief Finished segments, by the parity of the epoch they were
+        /// retired in
+        Segment* retired[2] = {};
+
+        static Slot* ToSlot(T* item) { return reinterpret_cast<Slot*>(item); }
+
+        static T* ToItem(Slot& slot) { return std::launder(reinterpret_cast<T*>(slot.storage)); }
+
+        /// @brief Moves the consumer to the next segment
+        /// @return \c false if no producer has gone past the current one yet
+        bool NextSegment() {
+            auto next = head->next.load(std::memory_order_acquire);
+            if (!next) return false;
+
+            // New producers must not find the finished segment as the tail
+            auto expected = head;
+            tail.compare_exchange_strong(expected, next);
+
+            auto current = epoch.load(std::memory_order_relaxed);
+
+            head->retired_next = retired[current & 1];
+            retired[current & 1] = head;
+
+            head = next;
+            head_index = 0;
+
+            // Producers of the other parity are from before the last advance.
+            // Once they are gone, both parities have been seen at 0 since the
+            // segments retired in the epoch before this one, so those can go.
+            // Producers keep coming in the current parity, so this does not
+            // wait for the queue to go quiet
+            if (claiming[(current + 1) & 1].load() == 0) {
+                FreeRetired(retired[(current + 1) & 1]);
+                epoch.store(current + 1);
+            }
+
+            return true;
+        }
+
+        static void FreeRetired(Segment*& list) {
+            while (list) {
+                auto next = list->retired_next;
+                MessagePool<Segment>::Delete(list);
+                list = next;
+            }
+        }
+
+    public:
+        SegmentedQueue() {
+            head = MessagePool<Segment>::New();
+            tail.store(head);
+        }
+
+        /// @brief Dont allow copy
+        SegmentedQueue(const SegmentedQueue&) = delete;
+
+        /// @brief Dont allow copy
+        SegmentedQueue& operator=(const SegmentedQueue&) = delete;
+
+        /// @brief Dont allow move
+        SegmentedQueue(SegmentedQueue&&) = delete;
+
+        /// @brief Dont allow move
+        SegmentedQueue& operator=(SegmentedQueue&&) = delete;
+
+        /// @brief Destroys the elements that were never popped. No producer
+        /// may be using the queue
+        ~SegmentedQueue() {
+            while (auto item = Pop()) Release(item);
+
+            FreeRetired(retired[0]);
+            FreeRetired(retired[1]);
+
+            while (head) {
+                auto next = head->next.load();
+                MessagePool<Segment>::Delete(head);
+                head = next;
+            }
+        }
+
+        /// @brief Takes the next slot and constructs an element in it. This
+        /// can be called from any thread
+        /// @return The element. Fill it in and Publish it. Constructing it
+        /// must not throw, as a slot that is never published stalls the
+        /// consumer
+        template <typename... Args>
+        T* Claim(Args&&... args) {
+            // Counted before the tail is read, so the consumer sees this
+            // before it frees a segment that was the tail
+            auto parity = epoch.load() & 1;
+            claiming[parity].fetch_add(1);
+
+            while (true) {
+                auto segment = tail.load();
+                auto index = segment->claimed.fetch_add(1, std::memory_order_relaxed);
+
+                if (index < SegmentSize) {
+                    claiming[parity].fetch_sub(1);
+                    return new (segment->slots[index].storage) T(std::forward<Args>(args)...);
+                }
+
+                // The segment is full. Link a new one, or help whoever did
+                auto next = segment->next.load(std::memory_order_acquire);
+
+                if (!next) {
+                    auto fresh = MessagePool<Segment>::New();
+
+                    if (segment->next.compare_exchange_strong(next, fresh, std::memory_order_acq_rel)) next = fresh;
+                    else MessagePool<Segment>::Delete(fresh);
+                }
+
+                tail.compare_exchange_strong(segment, next);
+            }
+        }
+
+        /// @brief Makes a claimed element visible to the consumer
+        inline void Publish(T* item) { ToSlot(item)->ready.store(true, std::memory_order_release); }
+
+        /// @brief Returns the oldest element without removing it. Only one
+        /// thread may pop at a time
+        /// @return The element, or \c nullptr if the queue is empty
+        T* Pop() {
+            if (head_index == SegmentSize && !NextSegment()) return nullptr;
+
+            auto& slot = head->slots[head_index];
+
+            if (!slot.ready.load(std::memory_order_acquire)) {
+                if (head->claimed.load(std::memory_order_acquire) <= head_index) return nullptr;
+
+                // A producer has claimed the slot but not published it yet.
+                // It is guaranteed to, so wait for it
+                while (!slot.ready.load(std::memory_order_acquire)) std::this_thread::yield();
+            }
+
+            return ToItem(slot);
+        }
+
+        /// @brief Destroys the element returned by Pop and moves past it
+        void Release(T* item) {
+            item->~T();
+            head_index++;
+        }
+    };
+
+}
+
+#endif
\ No newline at end of file
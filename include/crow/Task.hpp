@@ -0,0 +1,161 @@
+#ifndef CROW_TASK_HPP
+#define CROW_TASK_HPP
+
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <new>
+#include <optional>
+#include <utility>
+
+#include "Actor.hpp"
+#include "Crow.hpp"
+#include "Future.hpp"
+#include "Logging.hpp"
+#include "MessagePool.hpp"
+
+namespace crow {
+
+    template <size_t Size>
+    struct _InternalFrameBlock {
+        alignas(std::max_align_t) unsigned char storage[Size];
+    };
+
+    /// @brief Gets memory for a coroutine frame. Small frames come from a
+    /// MessagePool per size class, so starting a Task does not allocate once
+    /// the pools are warm
+    inline void* _InternalAllocateFrame(size_t size) {
+        if (size <= 128) return MessagePool<_InternalFrameBlock<128>>::Acquire();
+        if (size <= 256) return MessagePool<_InternalFrameBlock<256>>::Acquire();
+        if (size <= 512) return MessagePool<_InternalFrameBlock<512>>::Acquire();
+        if (size <= 1024) return MessagePool<_InternalFrameBlock<1024>>::Acquire();
+
+        return ::operator new(size);
+    }
+
+    inline void _InternalFreeFrame(void* frame, size_t size) {
+        if (size <= 128) MessagePool<_InternalFrameBlock<128>>::Release(frame);
+        else if (size <= 256) MessagePool<_InternalFrameBlock<256>>::Release(frame);
+        else if (size <= 512) MessagePool<_InternalFrameBlock<512>>::Release(frame);
+        else if (size <= 1024) MessagePool<_InternalFrameBlock<1024>>::Release(frame);
+        else ::operator delete(frame);
+    }
+
+    /// @brief The return type of an actor coroutine. It starts running inside
+    /// the handler that calls it and destroys itself when it finishes. When
+    /// it co_awaits a Future the thread goes back to the scheduler, and the
+    /// coroutine later continues on the same actor, never at the same time
+    /// as one of its handlers
+    class Task {
+    public:
+        struct promise_type {
+            Task get_return_object() noexcept { return {}; }
+
+            std::suspend_never initial_suspend() noexcept { return {}; }
+
+            std::suspend_never final_suspend() noexcept { return {}; }
+
+            void return_void() noexcept {}
+
+            void unhandled_exception() noexcept {
+                engine::Critical("Unhandled exception in an actor coroutine");
+            }
+
+            static void* operator new(size_t size) { return _InternalAllocateFrame(size); }
+
+            static void operator delete(void* frame, size_t size) { _InternalFreeFrame(frame, size); }
+        };
+    };
+
+    /// @brief Suspends a coroutine until a Future is ready and resumes it on
+    /// the actor that awaited
+    template <typename R>
+    class _InternalFutureAwaiter {
+    private:
+        Future<R> future;
+
+        static void Wake(_InternalAskState<R>* state) {
+            state->scheduler->PostResume(static_cast<_InternalResumeNode*>(state->context));
+        }
+
+    public:
+        explicit _InternalFutureAwaiter(Future<R>&& future) : future{std::move(future)} {}
+
+        bool await_ready() const { return !future.state || future.IsReady(); }
+
+        void await_suspend(std::coroutine_handle<> handle) {
+            auto state = future.state;
+
+            // If the value arrives before Continue, Wake runs right here and
+            // only queues the resume. The actor is still running, so the
+            // coroutine cannot continue before this returns
+            state->Continue(&Wake, state->scheduler->Suspend(handle));
+        }
+
+        std::optional<R> await_resume() { return future.Get(); }
+    };
+
+    /// @brief Suspends a coroutine for a while using a scheduler timer
+    class _InternalSleepAwaiter {
+    private:
+        struct Timer : public _InternalTimer {
+            _InternalResumeNode* node = nullptr;
+        };
+
+        std::chrono::steady_clock::duration delay;
+
+        static void Fire(_InternalTimer* timer, ActorScheduler* scheduler) {
+            scheduler->PostResume(std::exchange(static_cast<Timer*>(timer)->node, nullptr));
+        }
+
+        /// @brief A timer that never fired still owns the coroutine
+        static void Destroy(_InternalTimer* timer) {
+            auto self = static_cast<Timer*>(timer);
+
+            if (self->node) {
+                self->node->handle.destroy();
+                MessagePool<_InternalResumeNode>::Delete(self->node);
+            }
+
+            MessagePool<Timer>::Delete(self);
+        }
+
+    public:
+        explicit _InternalSleepAwaiter(std::chrono::steady_clock::duration delay) : delay{delay} {}
+
+        bool await_ready() const { return delay <= std::chrono::steady_clock::duration::zero(); }
+
+        void await_suspend(std::coroutine_handle<> handle) {
+            auto timer = MessagePool<Timer>::New();
+            timer->fire = &Fire;
+            timer->destroy = &Destroy;
+
+            auto scheduler = ActorScheduler::Running();
+
+            // A sleeping coroutine does not hold up its group, so a frame
+            // barrier does not wait for it
+            timer->node = scheduler->Suspend(handle, false);
+
+            scheduler->AddTimer(timer, delay, std::chrono::steady_clock::duration::zero());
+        }
+
+        void await_resume() const {}
+    };
+
+    /// @brief Suspends a Task for at least delay without blocking a thread.
+    /// It continues on its actor like any other co_await, on the scheduler
+    /// running that actor
+    inline _InternalSleepAwaiter Sleep(std::chrono::steady_clock::duration delay) {
+        return _InternalSleepAwaiter(delay);
+    }
+
+    /// @brief Waits for the reply of an Ask inside a Task
+    /// @return The value, or \c std::nullopt if the promise was broken
+    template <typename R>
+    inline _InternalFutureAwaiter<R> operator co_await(Future<R>&& future) {
+        return _InternalFutureAwaiter<R>(std::move(future));
+    }
+
+}
+
+#endif
\ No newline at end of file
@@ -2,77 +2,137 @@
 #define CROW_WINDOW_HPP
 
 #include <memory>
+#include <optional>
 #include <string>
 #include <tuple>
+#include <variant>
 #include <functional>
+#include <typeinfo>
 
 #include "Actor.hpp"
 
 namespace crow {
 
-    struct API WindowMessageBase {
-        virtual ~WindowMessageBase() = default;
-    };
-    struct API WindowGetResolution : public WindowMessageBase {
+    struct API WindowGetResolution {
         using Callback = std::function<void(const std::tuple<int, int>&)>;
-        const Callback callback;
+        Callback callback;
+
+        /// @brief Set when the message is sent with Ask
+        Promise<std::tuple<int, int>> reply;
+
+        WindowGetResolution() = default;
 
         WindowGetResolution(Callback callback) : callback{callback} {}
     };
 
-    struct API WindowGetFullscreenResolution : public WindowMessageBase {
+    struct API WindowGetFullscreenResolution {
         using Callback = std::function<void(const std::tuple<int, int>&)>;
-        const Callback callback;
+        Callback callback;
+
+        /// @brief Set when the message is sent with Ask
+        Promise<std::tuple<int, int>> reply;
+
+        WindowGetFullscreenResolution() = default;
 
         WindowGetFullscreenResolution(Callback callback) : callback{callback} {}
     };
 
-    struct API WindowSetResolution : public WindowMessageBase {
-        const std::tuple<int, int> resolution;
+    struct API WindowSetResolution {
+        std::tuple<int, int> resolution;
 
         WindowSetResolution(const std::tuple<int, int>& resolution) : resolution{resolution} {}
+
+        std::optional<size_t> CoalesceKey() const { return typeid(WindowSetResolution).hash_code(); }
     };
 
-    struct API WindowGetFullscreen : public WindowMessageBase {
+    struct API WindowGetFullscreen {
         using Callback = std::function<void(bool)>;
-        const Callback callback;
+        Callback callback;
+
+        /// @brief Set when the message is sent with Ask
+        Promise<bool> reply;
+
+        WindowGetFullscreen() = default;
 
         WindowGetFullscreen(Callback callback) : callback{callback} {}
     };
 
-    struct API WindowSetFullscreen : public WindowMessageBase {
-        const bool fullscreen;
+    struct API WindowSetFullscreen {
+        bool fullscreen;
 
-        WindowSetFullscreen(const bool fullscreen) : fullscreen{fullscreen} {}
+        WindowSetFullscreen(bool fullscreen) : fullscreen{fullscreen} {}
+
+        std::optional<size_t> CoalesceKey() const { return typeid(WindowSetFullscreen).hash_code(); }
     };
 
-    struct API WindowGetTitle : public WindowMessageBase {
+    struct API WindowGetTitle {
         using Callback = std::function<void(const std::string&)>;
-        const Callback callback;
+        Callback callback;
+
+        /// @brief Set when the message is sent with Ask
+        Promise<std::string> reply;
+
+        WindowGetTitle() = default;
 
         WindowGetTitle(Callback callback) : callback{callback} {}
     };
 
-    struct API WindowSetTitle : public WindowMessageBase {
-        const std::string title;
+    struct API WindowSetTitle {
+        std::string title;
 
         WindowSetTitle(const std::string& title) : title{title} {}
+
+        std::optional<size_t> CoalesceKey() const { return typeid(WindowSetTitle).hash_code(); }
     };
 
-    struct API WindowCenter : public WindowMessageBase {};
+    struct API WindowCenter {
+        std::optional<size_t> CoalesceKey() const { return typeid(WindowCenter).hash_code(); }
+    };
 
-    struct API WindowUpdate : public WindowMessageBase {};
+    struct API WindowUpdate {
+        std::optional<size_t> CoalesceKey() const { return typeid(WindowUpdate).hash_code(); }
+    };
 
-    struct API WindowCreate : public WindowMessageBase {};
+    struct API WindowCreate {};
 
-    struct API WindowShouldClose : public WindowMessageBase {
+    struct API WindowShouldClose {
         using Callback = std::function<void(bool)>;
-        const Callback callback;
+        Callback callback;
+
+        /// @brief Set when the message is sent with Ask
+        Promise<bool> reply;
+
+        WindowShouldClose() = default;
 
         WindowShouldClose(Callback callback) : callback{callback} {}
     };
 
-    struct API WindowClose : public WindowMessageBase {};
+    struct API WindowClose {};
+
+    /// @brief Published by the Window when its resolution changes. Inherit
+    /// Subscriber<WindowResized> and call ActorScheduler::Subscribe to get it
+    struct API WindowResized {
+        std::tuple<int, int> resolution;
+    };
+
+    /// @brief Every message the Window handles. Commands where only the
+    /// latest one matters have a CoalesceKey, so a newer one replaces any
+    /// still waiting. Queries never coalesce, since each one has to be
+    /// answered
+    using WindowMessage = std::variant<
+        WindowGetResolution,
+        WindowGetFullscreenResolution,
+        WindowSetResolution,
+        WindowGetFullscreen,
+        WindowSetFullscreen,
+        WindowGetTitle,
+        WindowSetTitle,
+        WindowCenter,
+        WindowUpdate,
+        WindowCreate,
+        WindowShouldClose,
+        WindowClose
+    >;
 
     /// @brief Manages the OpenGL/Vulkan/DirectX window
     class API _InternalWindow {
@@ -129,7 +189,20 @@ namespace crow {
         static std::unique_ptr<_InternalWindow> CreateWindow();
     };
 
-    class API Window : public Actor<WindowMessageBase> {
+    class API Window : public VariantActor<
+        WindowGetResolution,
+        WindowGetFullscreenResolution,
+        WindowSetResolution,
+        WindowGetFullscreen,
+        WindowSetFullscreen,
+        WindowGetTitle,
+        WindowSetTitle,
+        WindowCenter,
+        WindowUpdate,
+        WindowCreate,
+        WindowShouldClose,
+        WindowClose
+    > {
     private:
         std::unique_ptr<_InternalWindow> window = nullptr;
     
@@ -137,9 +210,27 @@ namespace crow {
         Window();
         ~Window() = default;
 
-        void HandleMessage(std::unique_ptr<WindowMessageBase>&& msg) override;
-
-        bool MainThreadOnly() const override { return true; }
+        void HandleMessage(WindowGetResolution&& msg) override;
+        void HandleMessage(WindowGetFullscreenResolution&& msg) override;
+        void HandleMessage(WindowSetResolution&& msg) override;
+        void HandleMessage(WindowGetFullscreen&& msg) override;
+        void HandleMessage(WindowSetFullscreen&& msg) override;
+        void HandleMessage(WindowGetTitle&& msg) override;
+        void HandleMessage(WindowSetTitle&& msg) override;
+        void HandleMessage(WindowCenter&& msg) override;
+        void HandleMessage(WindowUpdate&& msg) override;
+        void HandleMessage(WindowCreate&& msg) override;
+        void HandleMessage(WindowShouldClose&& msg) override;
+        void HandleMessage(WindowClose&& msg) override;
+
+        ExecutionClass GetExecutionClass() const override { return ExecutionClass::MainThread; }
+
+        Priority GetPriority() const override { return Priority::High; }
+
+        /// @brief Only the main thread drains the window, so senders wait for
+        /// it instead of queuing without limit, and repeated commands are
+        /// coalesced
+        MailboxSettings GetMailboxSettings() const override { return {1024, OverflowPolicy::Block, true}; }
     };
 
 }
@@ -1,5 +1,11 @@
 #include <crow/Actor.hpp>
 
+#include "TimerWheel.hpp"
+#include "Topology.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+
 #ifdef WINDOWS
 #include <Windows.h>
 #else
@@ -8,12 +14,126 @@
 
 namespace crow {
 
-    ActorScheduler::ActorScheduler(size_t thread_count) {
-        for (size_t i = 0; i < thread_count - 1; i++) {
-            threads.emplace_back(std::thread([&]() {
-                while (running) {
-                    if (!ProcessMessage(false)) YieldCPU();
+    static constexpr size_t no_worker = static_cast<size_t>(-1);
+
+    // The scheduler and worker index of the calling thread. The main thread,
+    // the blocking threads and any other thread have no_worker
+    static thread_local ActorScheduler* local_scheduler = nullptr;
+    static thread_local size_t local_worker = no_worker;
+    static thread_local bool local_blocking = false;
+
+    static thread_local MessageGroup* current_group = nullptr;
+
+    // The actor the calling thread is running, so a coroutine knows where to
+    // resume
+    static thread_local _InternalActorBase* current_actor = nullptr;
+    static thread_local ActorScheduler* current_scheduler = nullptr;
+
+    MessageGroup* MessageGroup::Swap(MessageGroup* group) {
+        auto previous = current_group;
+        current_group = group;
+        return previous;
+    }
+
+    MessageGroup* MessageGroup::Current() {
+        return current_group;
+    }
+
+    void MessageGroup::Finish(size_t count) {
+        // Once pending reaches 0 a waiter may destroy the group, so nothing
+        // of it can be touched after the decrement
+        auto scheduler = this->scheduler;
+
+        if (pending.fetch_sub(count) == count && scheduler) scheduler->WakeMainThread();
+    }
+
+    MessageGroup::~MessageGroup() {
+        if (!Done() && scheduler) scheduler->Wait(*this);
+    }
+
+    size_t _InternalMessageSlot::Assign(std::type_index type) {
+        static std::mutex lock;
+        static std::unordered_map<std::type_index, size_t> slots;
+
+        lock.lock();
+
+        auto found = slots.find(type);
+        auto slot = found != slots.end() ? found->second : slots.size();
+
+        if (found == slots.end()) slots[type] = slot;
+
+        lock.unlock();
+
+        return slot;
+    }
+
+    ActorScheduler::ActorScheduler(size_t thread_count, const ActorSchedulerSettings& settings) : settings{settings} {
+        registries.emplace_back(std::make_unique<_InternalActorRegistry>());
+        registry = registries.back().get();
+
+        timers = std::make_unique<_InternalTimerWheel>();
+
+        size_t worker_count = thread_count - 1;
+
+        std::vector<_InternalCore> cores;
+        if (settings.topology.pin_threads) cores = _InternalGetCores();
+
+        // The first core is the main thread's, so workers start at the next
+        auto core_of = [&](size_t worker) -> const _InternalCore& {
+            return cores[(worker + 1) % cores.size()];
+        };
+
+        auto node_of = [&](size_t worker) -> size_t {
+            return cores.empty() ? 0 : core_of(worker).node;
+        };
+
+        if (!cores.empty() && !_InternalPinCurrentThread(cores.front().cpu))
+            engine::Warning("Could not pin the main thread to core {}", cores.front().cpu);
+
+        if (settings.mode == SchedulingMode::WorkStealing) {
+            for (size_t i = 0; i < worker_count; i++)
+                worker_queues.emplace_back(std::make_unique<_InternalWorkQueue>());
+
+            // Start with the next worker so thieves spread out instead of all
+            // hitting worker 0. Workers on the same node go first if asked
+            for (size_t i = 0; i < worker_count; i++) {
+                std::vector<size_t> order;
+                for (size_t j = 1; j < worker_count; j++) order.push_back((i + j) % worker_count);
+
+                if (settings.topology.steal_within_node) {
+                    std::stable_partition(order.begin(), order.end(), [&](size_t victim) {
+                        return node_of(victim) == node_of(i);
+                    });
                 }
+
+                steal_order.push_back(std::move(order));
+            }
+        }
+
+        for (size_t i = 0; i < worker_count; i++) {
+            std::optional<_InternalCore> core;
+            if (!cores.empty()) core = core_of(i);
+
+            threads.emplace_back(std::thread([this, i, core]() {
+                local_scheduler = this;
+                local_worker = i;
+
+                if (core && !_InternalPinCurrentThread(core->cpu))
+                    engine::Warning("Could not pin worker {} to core {}", i, core->cpu);
+
+                WorkerLoop();
+            }));
+        }
+
+    }
+
+    void ActorScheduler::StartBlockingThreads() {
+        for (size_t i = 0; i < settings.blocking_threads; i++) {
+            blocking_pool.emplace_back(std::thread([this]() {
+                local_scheduler = this;
+                local_blocking = true;
+
+                BlockingLoop();
             }));
         }
     }
@@ -21,7 +141,184 @@ namespace crow {
     ActorScheduler::~ActorScheduler() {
         running = false;
 
+        idle_lock.lock();
+        idle_lock.unlock();
+        idle_cv.notify_all();
+
+        // Schedule checks running under blocking_lock, so no blocking thread
+        // is started after this
+        blocking_lock.lock();
+        auto blocking = std::move(blocking_pool);
+        blocking_lock.unlock();
+        blocking_cv.notify_all();
+
         for (auto& thread : threads) thread.join();
+        for (auto& thread : blocking) thread.join();
+
+        // External work reports back to the actors, so it has to be done
+        // before they are destroyed
+        while (external_work.load() != 0) YieldCPU();
+
+        // Timers may hold coroutines of the actors, so free them first
+        timers = nullptr;
+
+        // Destroying queued messages can break promises, which sends replies
+        // and resumes coroutines. Go back to the first, empty registry so
+        // nothing reaches an actor that is already gone, then free the actors
+        // while every other member is still alive. This also destroys the
+        // FileSystem, which joins the threads of its backend
+        registry.store(registries.front().get(), std::memory_order_release);
+
+        pools.clear();
+    }
+
+    _InternalActorBase* _InternalActorPool::Pick() {
+        if (policy != RoutingPolicy::LeastLoaded)
+            return instances[next.fetch_add(1, std::memory_order_relaxed) % instances.size()].get();
+
+        auto best = instances.front().get();
+        auto best_load = best->pending_messages.load(std::memory_order_relaxed);
+
+        for (size_t i = 1; i < instances.size() && best_load != 0; i++) {
+            auto load = instances[i]->pending_messages.load(std::memory_order_relaxed);
+
+            if (load < best_load) {
+                best = instances[i].get();
+                best_load = load;
+            }
+        }
+
+        return best;
+    }
+
+    void ActorScheduler::PublishRegistry(std::unique_ptr<_InternalActorRegistry> next) {
+        registry.store(next.get(), std::memory_order_release);
+        registries.push_back(std::move(next));
+    }
+
+    void ActorScheduler::PublishRoute(size_t slot, std::unique_ptr<_InternalActorPool> pool) {
+        auto next = std::make_unique<_InternalActorRegistry>(*registry.load());
+
+        if (slot >= next->routes.size()) next->routes.resize(slot + 1, nullptr);
+
+        next->routes[slot] = pool.get();
+
+        pools.push_back(std::move(pool));
+
+        PublishRegistry(std::move(next));
+    }
+
+    void ActorScheduler::PublishTopic(size_t topic, const std::vector<_InternalSubscription>& subscriptions) {
+        auto next = std::make_unique<_InternalActorRegistry>(*registry.load());
+
+        if (topic >= next->topics.size()) next->topics.resize(topic + 1);
+
+        auto& subscribers = next->topics[topic];
+
+        for (auto& subscription : subscriptions) {
+            auto subscribed = std::find_if(subscribers.begin(), subscribers.end(), [&](const _InternalSubscription& other) {
+                return other.actor == subscription.actor;
+            });
+
+            if (subscribed == subscribers.end()) subscribers.push_back(subscription);
+        }
+
+        PublishRegistry(std::move(next));
+    }
+
+    void ActorScheduler::Seal() {
+        sealed = true;
+    }
+
+    void ActorScheduler::WorkerLoop() {
+        const auto& idle = settings.idle;
+
+        size_t idle_count = 0;
+
+        while (running) {
+            if (ProcessMessage(false)) {
+                idle_count = 0;
+                continue;
+            }
+
+            idle_count++;
+
+            if (idle_count <= idle.spin_count) continue;
+
+            if (!idle.park || idle_count <= idle.spin_count + idle.yield_count) {
+                YieldCPU();
+                continue;
+            }
+
+            Park();
+            idle_count = 0;
+        }
+    }
+
+    void ActorScheduler::BlockingLoop() {
+        while (running) {
+            if (ProcessBlockingMessage()) continue;
+
+            // Schedule takes blocking_lock after queuing an actor, so checking
+            // under it cannot miss one
+            std::unique_lock guard(blocking_lock);
+            blocking_cv.wait(guard, [&]() { return !blocking_to_do.Empty() || !running; });
+        }
+    }
+
+    bool ActorScheduler::ProcessBlockingMessage() {
+        auto actor = blocking_to_do.Steal(settings.starvation_limit);
+
+        if (!actor) return false;
+
+        RunActor(actor);
+
+        return true;
+    }
+
+    bool ActorScheduler::ProcessLocalMessage() {
+        if (local_scheduler == this && local_blocking) return ProcessBlockingMessage();
+
+        return ProcessMessage(IsMainThread());
+    }
+
+    void ActorScheduler::Park() {
+        // Announce we are going to sleep before the last look for work. Any
+        // message scheduled after that look bumps wake_epoch and sees
+        // sleeping > 0, so the wakeup cannot be lost
+        sleeping++;
+        auto epoch = wake_epoch.load();
+
+        if (ProcessMessage(false)) {
+            sleeping--;
+            return;
+        }
+
+        auto woken = [&]() { return wake_epoch.load() != epoch || !running; };
+
+        // Sleep no later than the next timer, so some thread fires it
+        std::unique_lock guard(idle_lock);
+
+        auto due = next_timer.load();
+        if (due == no_timer) idle_cv.wait(guard, woken);
+        else idle_cv.wait_until(guard, TickTime(due), woken);
+
+        sleeping--;
+    }
+
+    void ActorScheduler::WakeWorker() {
+        wake_epoch++;
+
+        // With every worker busy, a main thread waiting on a group can take
+        // the work instead
+        if (sleeping.load() == 0) {
+            if (main_waiting.load()) WakeMainThread();
+            return;
+        }
+
+        idle_lock.lock();
+        idle_lock.unlock();
+        idle_cv.notify_one();
     }
 
     void ActorScheduler::YieldCPU() const {
@@ -32,43 +329,494 @@ namespace crow {
 #endif
     }
 
-    bool ActorScheduler::ProcessMessage(bool is_main) {
-        ActorPtr actor = nullptr;
+    void ActorScheduler::Schedule(_InternalActorBase* actor) {
+        if (actor->execution == ExecutionClass::Blocking) {
+            blocking_to_do.Push(actor);
 
-        lock.lock();
-        if (is_main) {
-            if (main_to_do.size() != 0) {
-                actor = main_to_do.front();
-                main_to_do.erase(main_to_do.begin());
+            blocking_lock.lock();
+            if (blocking_pool.empty() && running.load()) StartBlockingThreads();
+            blocking_lock.unlock();
+
+            blocking_cv.notify_one();
+            return;
+        }
+
+        bool is_main = actor->execution == ExecutionClass::MainThread;
+
+        if (!is_main && !worker_queues.empty()) {
+            auto worker = local_scheduler == this ? local_worker : no_worker;
+
+            if (settings.actor_affinity) {
+                auto last = actor->last_worker.load(std::memory_order_relaxed);
+                if (last != no_worker) worker = last;
             }
-            else if (to_do.size() != 0) {
-                actor = to_do.front();
-                to_do.erase(to_do.begin());
+
+            if (worker != no_worker) {
+                worker_queues[worker]->Push(actor);
+                WakeWorker();
+                return;
             }
         }
-        else if (to_do.size() != 0) {
-            actor = to_do.front();
-            to_do.erase(to_do.begin());
+
+        if (is_main) main_to_do.Push(actor);
+        else to_do.Push(actor);
+
+        if (is_main) WakeMainThread();
+        else WakeWorker();
+    }
+
+    void ActorScheduler::Raise(_InternalActorBase* actor, Priority lane) {
+        // The lane was already this high, so whoever raised it moves the actor
+        if (!actor->RaiseLane(lane)) return;
+
+        // Pairs with the store in _InternalWorkQueue::Push. Either this sees
+        // the queue, or the push sees the raised lane
+        if (auto queue = actor->run_queue.load()) queue->Raise(actor, lane);
+    }
+
+    void ActorScheduler::Prioritize(_InternalActorBase* actor, const SendOptions& options) {
+        if (options.priority) Raise(actor, *options.priority);
+
+        if (!options.deadline) return;
+
+        if (*options.deadline - settings.deadline_lead <= std::chrono::steady_clock::now()) Raise(actor, Priority::High);
+    }
+
+    void ActorScheduler::TrackDeadline(_InternalActorBase* actor, const SendOptions& options) {
+        if (!options.deadline) return;
+
+        auto urgent = (*options.deadline - settings.deadline_lead).time_since_epoch().count();
+
+        // A message with an earlier deadline is already tracked
+        if (!_InternalLowerTicks(actor->urgent_at, urgent)) return;
+
+        // Pairs with the load in _InternalWorkQueue::Push. Either this sees
+        // the queue, or the push sees the deadline
+        if (auto queue = actor->run_queue.load()) queue->NoteUrgent(urgent);
+    }
+
+    _InternalActorBase* ActorScheduler::FindWork(bool is_main) {
+        _InternalActorBase* actor = nullptr;
+
+        PollTimers();
+
+        size_t worker = local_scheduler == this ? local_worker : no_worker;
+
+        if (worker != no_worker && !worker_queues.empty()) {
+            actor = worker_queues[worker]->Pop(settings.starvation_limit);
+            if (actor) return actor;
         }
-        lock.unlock();
+
+        if (is_main) actor = main_to_do.Steal(settings.starvation_limit);
+        if (!actor) actor = to_do.Steal(settings.starvation_limit);
+
+        if (actor) return actor;
+
+        if (worker != no_worker && !worker_queues.empty()) {
+            for (auto victim : steal_order[worker]) {
+                actor = worker_queues[victim]->Steal(settings.starvation_limit);
+                if (actor) return actor;
+            }
+
+            return nullptr;
+        }
+
+        for (auto& queue : worker_queues) {
+            actor = queue->Steal(settings.starvation_limit);
+            if (actor) return actor;
+        }
+
+        return nullptr;
+    }
+
+    bool ActorScheduler::ProcessMessage(bool is_main) {
+        auto actor = FindWork(is_main);
 
         if (!actor) return false;
 
-        working++;
-        actor->ProcessMessage();
-        working--;
+        RunActor(actor);
 
         return true;
     }
 
-    void ActorScheduler::ProcessAllMessages() {
-        while (true) {
-            if (ProcessMessage(true)) continue;
+    void ActorScheduler::RunActor(_InternalActorBase* actor) {
+        if (local_scheduler == this && local_worker != no_worker)
+            actor->last_worker.store(local_worker, std::memory_order_relaxed);
+
+        // Deadlines are recorded after their message is counted, so every
+        // message behind the taken deadline is counted below
+        auto urgent = actor->urgent_at.exchange(_internal_no_deadline);
+
+        auto count = std::min(actor->pending_messages.load(), std::max<size_t>(settings.throughput, 1));
+
+        auto previous = current_actor;
+        auto previous_scheduler = current_scheduler;
+        current_actor = actor;
+        current_scheduler = this;
+
+        auto handled = RunResumes(actor, count);
+        if (handled < count) handled += RunEvents(actor, count - handled);
+        if (handled < count) actor->ProcessMessages(count - handled);
+
+        current_actor = previous;
+        current_scheduler = previous_scheduler;
+
+        // Messages that arrived while running did not queue the actor, so
+        // queue it again for them. Messages left over may have the deadline
+        // taken above
+        if (actor->pending_messages.fetch_sub(count) != count) {
+            if (urgent != _internal_no_deadline) _InternalLowerTicks(actor->urgent_at, urgent);
+
+            Schedule(actor);
+        }
+
+        FinishMessages(count);
+    }
+
+    _InternalResumeNode* ActorScheduler::Suspend(std::coroutine_handle<> handle, bool join_group) {
+        if (!current_actor) engine::Critical("A coroutine can only co_await while running on an actor");
+
+        auto node = MessagePool<_InternalResumeNode>::New();
+        node->handle = handle;
+        node->actor = current_actor;
+        node->group = join_group ? MessageGroup::Current() : nullptr;
+
+        if (node->group) node->group->pending++;
+
+        return node;
+    }
+
+    ActorScheduler* ActorScheduler::Running() {
+        if (!current_scheduler) engine::Critical("A coroutine can only co_await while running on an actor");
+
+        return current_scheduler;
+    }
+
+    void ActorScheduler::PostResume(_InternalResumeNode* node) {
+        auto actor = node->actor;
+
+        // Nothing runs anymore, and the actor may already be destroyed
+        if (!running.load()) {
+            node->handle.destroy();
+            MessagePool<_InternalResumeNode>::Delete(node);
+            return;
+        }
+
+        actor->resumes.Push(node);
+
+        in_flight++;
+
+        if (actor->pending_messages.fetch_add(1) == 0) Schedule(actor);
+    }
+
+    size_t ActorScheduler::RunResumes(_InternalActorBase* actor, size_t limit) {
+        size_t resumed = 0;
+
+        // This can take a resume whose pending_messages increment has not
+        // happened yet. That only leaves fewer messages to take from the
+        // mailbox, and the counts still balance once the increment lands
+        while (resumed < limit) {
+            auto node = actor->resumes.Pop();
+            if (!node) break;
+
+            auto handle = node->handle;
+            auto group = node->group;
+
+            MessagePool<_InternalResumeNode>::Delete(node);
+
+            auto previous = MessageGroup::Swap(group);
+            handle.resume();
+            MessageGroup::Swap(previous);
+
+            if (group) group->Finish(1);
+
+            resumed++;
+        }
+
+        return resumed;
+    }
+
+    void ActorScheduler::PostEvent(const _InternalSubscription& subscription, const std::shared_ptr<const void>& event, const SendOptions& options) {
+        auto actor = subscription.actor;
+
+        auto node = MessagePool<_InternalEventNode>::New();
+        node->event = event;
+        node->handle = subscription.handle;
+        node->deadline = options.deadline.value_or(std::chrono::steady_clock::time_point::max());
+        node->group = MessageGroup::Current();
 
-            if (working > 0) continue;
+        if (node->group) node->group->pending++;
 
-            break;
+        Prioritize(actor, options);
+
+        actor->events.Push(node);
+
+        in_flight++;
+
+        if (actor->pending_messages.fetch_add(1) == 0) Schedule(actor);
+
+        TrackDeadline(actor, options);
+    }
+
+    size_t ActorScheduler::RunEvents(_InternalActorBase* actor, size_t limit) {
+        size_t handled = 0;
+
+        // Like RunResumes, this can take an event that is not counted yet
+        while (handled < limit) {
+            auto node = actor->events.Pop();
+            if (!node) break;
+
+            auto event = std::move(node->event);
+            auto handle = node->handle;
+            auto deadline = node->deadline;
+            auto group = node->group;
+
+            MessagePool<_InternalEventNode>::Delete(node);
+
+            if (deadline != std::chrono::steady_clock::time_point::max() && std::chrono::steady_clock::now() > deadline)
+                actor->missed_deadlines++;
+
+            auto previous = MessageGroup::Swap(group);
+            handle(actor, std::move(event));
+            MessageGroup::Swap(previous);
+
+            if (group) group->Finish(1);
+
+            handled++;
         }
+
+        return handled;
+    }
+
+    TimerHandle ActorScheduler::AddTimer(_InternalTimer* timer, std::chrono::steady_clock::duration delay, std::chrono::steady_clock::duration period) {
+        using std::chrono::milliseconds;
+
+        auto due = std::chrono::ceil<milliseconds>(std::chrono::steady_clock::now() + delay - timer_start).count();
+
+        timer->period = 0;
+        if (period > std::chrono::steady_clock::duration::zero())
+            timer->period = std::max<uint64_t>(std::chrono::ceil<milliseconds>(period).count(), 1);
+
+        timer_lock.lock();
+
+        timer->due = std::max<uint64_t>(std::max<int64_t>(due, 0), timers->GetCurrent() + 1);
+
+        auto handle = timers->Insert(timer);
+
+        auto next = timers->NextDue();
+        auto previous = next_timer.exchange(next);
+
+        timer_lock.unlock();
+
+        // A parked thread may be sleeping until a later timer
+        if (next < previous) WakeWorker();
+
+        return handle;
+    }
+
+    bool ActorScheduler::Cancel(TimerHandle handle) {
+        timer_lock.lock();
+
+        auto cancelled = timers->Cancel(handle);
+        next_timer = timers->NextDue();
+
+        timer_lock.unlock();
+
+        return cancelled;
+    }
+
+    void ActorScheduler::PollTimers() {
+        auto due = next_timer.load(std::memory_order_relaxed);
+        if (due == no_timer) return;
+
+        auto now = std::chrono::floor<std::chrono::milliseconds>(std::chrono::steady_clock::now() - timer_start).count();
+        if (now < 0 || static_cast<uint64_t>(now) < due) return;
+
+        if (!timer_lock.try_lock()) return;
+
+        auto fired = timers->Advance(now);
+        next_timer = timers->NextDue();
+
+        timer_lock.unlock();
+
+        if (!fired) return;
+
+        // Fire without the lock. A send to a full mailbox can run handlers
+        // right here, and they may add or cancel timers
+        _InternalTimer* periodic = nullptr;
+
+        // Messages sent by timers do not belong to the group of whatever this
+        // thread was doing
+        auto previous = MessageGroup::Swap(nullptr);
+
+        while (fired) {
+            auto timer = fired;
+            fired = timer->next;
+
+            timer->fire(timer, this);
+
+            if (timer->period == 0) timer->destroy(timer);
+            else {
+                timer->next = periodic;
+                periodic = timer;
+            }
+        }
+
+        MessageGroup::Swap(previous);
+
+        if (!periodic) return;
+
+        timer_lock.lock();
+
+        while (periodic) {
+            auto timer = periodic;
+            periodic = timer->next;
+
+            timers->Rearm(timer);
+        }
+
+        auto next = timers->NextDue();
+        auto before = next_timer.exchange(next);
+
+        timer_lock.unlock();
+
+        // A thread may have parked while the timers were out of the wheel
+        if (next < before) WakeWorker();
+    }
+
+    ActorScheduler::Admission ActorScheduler::Admit(_InternalActorBase* actor) {
+        const auto& mailbox = actor->mailbox_settings;
+
+        if (mailbox.capacity == 0) {
+            actor->AddQueued();
+            return Admission::Accepted;
+        }
+
+        while (!actor->TryAddQueued(mailbox.capacity)) {
+            switch (mailbox.overflow) {
+            case OverflowPolicy::Block:
+                if (actor == current_actor) {
+                    actor->AddQueued();
+                    return Admission::Accepted;
+                }
+
+                if (!ProcessLocalMessage()) YieldCPU();
+                break;
+
+            case OverflowPolicy::DropNewest:
+                actor->dropped_messages++;
+                return Admission::Dropped;
+
+            case OverflowPolicy::DropOldest:
+                return Admission::Replace;
+
+            case OverflowPolicy::Reject:
+                actor->dropped_messages++;
+                return Admission::Rejected;
+            }
+        }
+
+        return Admission::Accepted;
+    }
+
+    _InternalExternalWork _InternalExternalWork::Start() {
+        _InternalExternalWork work;
+        work.scheduler = local_scheduler ? local_scheduler : actor_scheduler.get();
+        if (!work.scheduler) return work;
+
+        work.group = MessageGroup::Current();
+        if (work.group) work.group->pending++;
+
+        work.scheduler->external_work++;
+        work.scheduler->in_flight++;
+
+        return work;
+    }
+
+    void _InternalExternalWork::Finish() {
+        if (!scheduler) return;
+
+        if (group) group->Finish(1);
+
+        auto finished = std::exchange(scheduler, nullptr);
+        group = nullptr;
+
+        finished->FinishMessages(1);
+
+        // Last, as the scheduler may be destroyed as soon as this reaches 0.
+        // The reply was already delivered by Finish(report)
+        finished->external_work--;
+    }
+
+    void ActorScheduler::FinishMessages(size_t count) {
+        if (in_flight.fetch_sub(count) == count) WakeMainThread();
+    }
+
+    void ActorScheduler::WakeMainThread() {
+        main_epoch++;
+
+        if (!main_waiting.load()) return;
+
+        quiescence_lock.lock();
+        quiescence_lock.unlock();
+        quiescence_cv.notify_all();
+    }
+
+    void ActorScheduler::WaitForMainThreadWork(const std::atomic_size_t& counter) {
+        // Same handshake as Park. Anything that changes what we wait on bumps
+        // main_epoch after we announced ourselves, so it cannot be missed
+        main_waiting = true;
+        auto epoch = main_epoch.load();
+
+        if (counter.load() == 0 || ProcessMessage(true)) {
+            main_waiting = false;
+            return;
+        }
+
+        auto woken = [&]() { return counter.load() == 0 || main_epoch.load() != epoch; };
+
+        std::unique_lock guard(quiescence_lock);
+
+        auto due = next_timer.load();
+        if (due == no_timer) quiescence_cv.wait(guard, woken);
+        else quiescence_cv.wait_until(guard, TickTime(due), woken);
+
+        main_waiting = false;
+    }
+
+    void ActorScheduler::HelpUntil(const std::atomic_size_t& counter) {
+        bool is_main = IsMainThread();
+
+        // Without workers nobody else fires timers
+        PollTimers();
+
+        while (counter.load() != 0) {
+            if (ProcessLocalMessage()) continue;
+
+            if (is_main) WaitForMainThreadWork(counter);
+            else YieldCPU();
+        }
+    }
+
+    void _InternalHelpUntil(ActorScheduler* scheduler, const std::atomic_size_t& counter) {
+        scheduler->HelpUntil(counter);
+    }
+
+    void _InternalWakeHelpers(ActorScheduler* scheduler) {
+        scheduler->WakeMainThread();
+    }
+
+    void ActorScheduler::ProcessAllMessages() {
+        HelpUntil(in_flight);
+    }
+
+    MessageGroup::Scope ActorScheduler::Track(MessageGroup& group) {
+        group.scheduler = this;
+        return MessageGroup::Scope(group);
+    }
+
+    void ActorScheduler::Wait(const MessageGroup& group) {
+        HelpUntil(group.pending);
     }
 
     std::unique_ptr<ActorScheduler> actor_scheduler = nullptr;
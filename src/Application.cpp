@@ -1,33 +1,125 @@
 #include <crow/Application.hpp>
 
 #include <crow/Actor.hpp>
+#include <crow/File.hpp>
 #include <crow/Window.hpp>
 
+#include <algorithm>
+#include <cmath>
 #include <thread>
 
+#ifdef WINDOWS
+#include <Windows.h>
+#include <timeapi.h>
+#endif
+
 namespace crow {
 
     size_t Application::GetThreadCount() const {
         return std::thread::hardware_concurrency();
     }
 
+    ActorSchedulerSettings Application::GetActorSchedulerSettings() const {
+        return {};
+    }
+
+    RunLoopSettings Application::GetRunLoopSettings() const {
+        return {};
+    }
+
+    void Application::WaitUntil(std::chrono::steady_clock::time_point deadline, std::chrono::microseconds spin_threshold) const {
+        auto now = std::chrono::steady_clock::now();
+
+        if (deadline - now > spin_threshold) std::this_thread::sleep_for(deadline - now - spin_threshold);
+
+        while (std::chrono::steady_clock::now() < deadline) std::this_thread::yield();
+    }
+
     void Application::_InternalRun() {
         OnPreActorSchedulerSetup();
 
-        actor_scheduler = ActorScheduler::Create(GetThreadCount());
+        actor_scheduler = ActorScheduler::Create(GetThreadCount(), GetActorSchedulerSettings());
 
         // Register internal actor types
         actor_scheduler->Register<Window>();
+        actor_scheduler->Register<FileSystem>();
 
         OnRegisterActors();
 
         OnPostActorSchedulerSetup();
 
+        actor_scheduler->Seal();
+
+        auto run_loop = GetRunLoopSettings();
+
+        using Clock = std::chrono::steady_clock;
+
+        Clock::duration frame_time = Clock::duration::zero();
+        if (run_loop.target_fps > 0)
+            frame_time = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / run_loop.target_fps));
+
+#ifdef WINDOWS
+        // The default timer resolution makes sleeps overshoot by up to 15 ms
+        if (frame_time != Clock::duration::zero()) timeBeginPeriod(1);
+#endif
+
+        auto last_frame = Clock::now();
+        auto next_frame = last_frame + frame_time;
+
+        double accumulator = 0;
+
         while (running) {
-            OnUpdate();
-            actor_scheduler->ProcessAllMessages();
+            auto now = Clock::now();
+            double delta = std::chrono::duration<double>(now - last_frame).count();
+            last_frame = now;
+
+            if (run_loop.fixed_timestep > 0) {
+                accumulator += delta;
+
+                size_t steps = 0;
+                while (accumulator >= run_loop.fixed_timestep && steps < run_loop.max_fixed_steps) {
+                    MessageGroup step;
+
+                    {
+                        auto tracking = actor_scheduler->Track(step);
+                        OnFixedUpdate(run_loop.fixed_timestep);
+                    }
+
+                    actor_scheduler->Wait(step);
+
+                    accumulator -= run_loop.fixed_timestep;
+                    steps++;
+                }
+
+                if (accumulator >= run_loop.fixed_timestep) accumulator = std::fmod(accumulator, run_loop.fixed_timestep);
+
+                interpolation_alpha = accumulator / run_loop.fixed_timestep;
+            }
+
+            // The frame is done once everything OnUpdate sent, and everything
+            // that sent in turn, has been handled
+            MessageGroup frame;
+
+            {
+                auto tracking = actor_scheduler->Track(frame);
+                OnUpdate(delta);
+            }
+
+            actor_scheduler->Wait(frame);
+
+            if (frame_time == Clock::duration::zero()) continue;
+
+            WaitUntil(next_frame, run_loop.spin_threshold);
+
+            // After a long frame start counting again from now, instead of
+            // running frames back to back to catch up
+            next_frame = std::max(next_frame + frame_time, Clock::now());
         }
 
+#ifdef WINDOWS
+        if (frame_time != Clock::duration::zero()) timeEndPeriod(1);
+#endif
+
         OnPreActorSchedulerCleanup();
 
         actor_scheduler->ProcessAllMessages();
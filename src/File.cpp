@@ -0,0 +1,43 @@
+#include <crow/File.hpp>
+
+#include "FileBackend.hpp"
+
+namespace crow {
+
+    FileSystem::FileSystem() = default;
+
+    FileSystem::~FileSystem() = default;
+
+    _InternalFileBackend& FileSystem::GetBackend() {
+        if (!backend) backend = _InternalFileBackend::Create();
+
+        return *backend;
+    }
+
+    void FileSystem::HandleMessage(FileRead&& msg) {
+        auto op = std::make_unique<_InternalFileOperation>();
+        op->kind = _InternalFileOperation::Kind::Read;
+        op->path = std::move(msg.path);
+        op->offset = msg.offset;
+        op->size = msg.size;
+        op->reply = std::move(msg.reply);
+        op->work = _InternalExternalWork::Start();
+
+        GetBackend().Submit(std::move(op));
+    }
+
+    void FileSystem::HandleMessage(FileWrite&& msg) {
+        auto op = std::make_unique<_InternalFileOperation>();
+        op->kind = _InternalFileOperation::Kind::Write;
+        op->path = std::move(msg.path);
+        op->offset = msg.offset;
+        op->size = msg.data.size();
+        op->truncate = msg.truncate;
+        op->data = std::move(msg.data);
+        op->reply = std::move(msg.reply);
+        op->work = _InternalExternalWork::Start();
+
+        GetBackend().Submit(std::move(op));
+    }
+
+}
\ No newline at end of file
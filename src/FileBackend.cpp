@@ -0,0 +1,461 @@
+#include "FileBackend.hpp"
+
+#include <crow/Logging.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define CROW_IO_URING
+#endif
+
+#ifdef CROW_IO_URING
+#include <atomic>
+#include <cstring>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace crow {
+
+    void _InternalCompleteFile(std::unique_ptr<_InternalFileOperation> op, int error) {
+        FileResult result;
+        result.path = std::move(op->path);
+        result.bytes = op->done;
+        result.error = error;
+
+        if (op->kind == _InternalFileOperation::Kind::Read) {
+            op->data.resize(op->done);
+            result.data = std::move(op->data);
+        }
+
+        op->work.Finish([&]() { op->reply.Set(std::move(result)); });
+    }
+
+    /// @brief Runs each operation start to finish with blocking calls on a
+    /// few threads of its own
+    class _InternalThreadFileBackend : public _InternalFileBackend {
+    private:
+        std::mutex lock;
+        std::condition_variable cv;
+        std::deque<std::unique_ptr<_InternalFileOperation>> queue;
+        bool stopping = false;
+
+        std::vector<std::thread> threads;
+
+        static int Read(_InternalFileOperation& op) {
+            std::ifstream file(op.path, std::ios::binary);
+            if (!file) return errno != 0 ? errno : ENOENT;
+
+            if (op.size == FileRead::whole_file) {
+                file.seekg(0, std::ios::end);
+
+                auto end = static_cast<uint64_t>(file.tellg());
+                op.size = end > op.offset ? static_cast<size_t>(end - op.offset) : 0;
+            }
+
+            if (op.size == 0) return 0;
+
+            op.data.resize(op.size);
+
+            file.seekg(static_cast<std::streamoff>(op.offset));
+            file.read(reinterpret_cast<char*>(op.data.data()), static_cast<std::streamsize>(op.size));
+
+            op.done = static_cast<size_t>(file.gcount());
+
+            return file.bad() ? EIO : 0;
+        }
+
+        static int Write(_InternalFileOperation& op) {
+            std::fstream file;
+
+            // Writing into a file needs in, which fails if there is no file
+            if (!op.truncate) file.open(op.path, std::ios::binary | std::ios::in | std::ios::out);
+            if (!file.is_open()) file.open(op.path, std::ios::binary | std::ios::out | std::ios::trunc);
+            if (!file) return errno != 0 ? errno : EACCES;
+
+            file.seekp(static_cast<std::streamoff>(op.offset));
+            file.write(reinterpret_cast<const char*>(op.data.data()), static_cast<std::streamsize>(op.data.size()));
+            file.flush();
+
+            if (!file) return EIO;
+
+            op.done = op.data.size();
+
+            return 0;
+        }
+
+        void Run() {
+            while (true) {
+                std::unique_lock guard(lock);
+                cv.wait(guard, [&]() { return !queue.empty() || stopping; });
+
+                if (queue.empty()) return;
+
+                auto op = std::move(queue.front());
+                queue.pop_front();
+
+                guard.unlock();
+
+                errno = 0;
+                int error = op->kind == _InternalFileOperation::Kind::Read ? Read(*op) : Write(*op);
+
+                _InternalCompleteFile(std::move(op), error);
+            }
+        }
+
+    public:
+        explicit _InternalThreadFileBackend(size_t thread_count) {
+            for (size_t i = 0; i < thread_count; i++) threads.emplace_back([this]() { Run(); });
+        }
+
+        ~_InternalThreadFileBackend() {
+            lock.lock();
+            stopping = true;
+            lock.unlock();
+
+            cv.notify_all();
+
+            for (auto& thread : threads) thread.join();
+        }
+
+        void Submit(std::unique_ptr<_InternalFileOperation> op) override {
+            lock.lock();
+            queue.push_back(std::move(op));
+            lock.unlock();
+
+            cv.notify_one();
+        }
+    };
+
+#ifdef CROW_IO_URING
+
+    /// @brief Queues transfers on an io_uring made with raw system calls. The
+    /// calling thread opens the file and submits, and one thread of its own
+    /// reaps completions, so any number of transfers can be in flight
+    class _InternalUringFileBackend : public _InternalFileBackend {
+    private:
+        struct Operation {
+            std::unique_ptr<_InternalFileOperation> op;
+            int fd = -1;
+            iovec buffer = {};
+        };
+
+        /// @brief Each submission moves at most this much, so the length
+        /// fits the ring's 32 bits
+        static constexpr size_t max_transfer = size_t(1) << 30;
+
+        /// @brief The user_data of the no-op that stops the reaper
+        static constexpr uint64_t stop_token = 0;
+
+        int ring = -1;
+
+        void* sq_ring = MAP_FAILED;
+        void* cq_ring = MAP_FAILED;
+        size_t sq_ring_size = 0;
+        size_t cq_ring_size = 0;
+
+        io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+        size_t sqes_size = 0;
+
+        unsigned* sq_head = nullptr;
+        unsigned* sq_tail = nullptr;
+        unsigned sq_mask = 0;
+        unsigned* sq_array = nullptr;
+
+        unsigned* cq_head = nullptr;
+        unsigned* cq_tail = nullptr;
+        unsigned cq_mask = 0;
+        io_uring_cqe* cqes = nullptr;
+
+        /// @brief Guards the submission ring and in_flight
+        std::mutex lock;
+        std::condition_variable room;
+
+        /// @brief Kept below the completion ring size, so no completion is
+        /// ever dropped on kernels without IORING_FEAT_NODROP
+        size_t in_flight = 0;
+        size_t max_in_flight = 0;
+
+        std::thread reaper;
+
+        static int Setup(unsigned entries, io_uring_params* params) {
+            return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+        }
+
+        static int Enter(int ring, unsigned to_submit, unsigned min_complete, unsigned flags) {
+            return static_cast<int>(syscall(__NR_io_uring_enter, ring, to_submit, min_complete, flags, nullptr, 0));
+        }
+
+        /// @brief Puts one entry on the submission ring and hands it to the
+        /// kernel. Must be called with lock held
+        /// @return 0, or the errno code if the kernel did not take the entry
+        int Push(uint8_t opcode, int fd, const iovec* buffer, uint64_t offset, uint64_t user_data) {
+            auto tail = *sq_tail;
+            auto index = tail & sq_mask;
+
+            auto sqe = &sqes[index];
+            std::memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = opcode;
+            sqe->fd = fd;
+            sqe->off = offset;
+            sqe->addr = reinterpret_cast<uint64_t>(buffer);
+            sqe->len = buffer ? 1 : 0;
+            sqe->user_data = user_data;
+
+            sq_array[index] = index;
+
+            std::atomic_ref<unsigned>(*sq_tail).store(tail + 1, std::memory_order_release);
+
+            // Without SQPOLL the kernel takes the entry during this call, so
+            // the submission ring is empty again afterwards
+            while (true) {
+                auto submitted = Enter(ring, 1, 0, 0);
+                if (submitted > 0) return 0;
+
+                int error = submitted < 0 ? errno : EIO;
+                if (error == EINTR || error == EAGAIN || error == EBUSY) continue;
+
+                // Take the entry back, or the next call would submit it after
+                // its operation is gone
+                std::atomic_ref<unsigned>(*sq_tail).store(tail, std::memory_order_release);
+
+                return error;
+            }
+        }
+
+        /// @brief Submits the rest of a transfer. Must be called with lock
+        /// held
+        /// @return 0, or the errno code if it could not be submitted
+        int Queue(Operation* operation) {
+            auto& op = *operation->op;
+
+            operation->buffer.iov_base = op.data.data() + op.done;
+            operation->buffer.iov_len = std::min(op.size - op.done, max_transfer);
+
+            auto opcode = op.kind == _InternalFileOperation::Kind::Read ? IORING_OP_READV : IORING_OP_WRITEV;
+
+            return Push(static_cast<uint8_t>(opcode), operation->fd, &operation->buffer, op.offset + op.done, reinterpret_cast<uint64_t>(operation));
+        }
+
+        void Finish(Operation* operation, int error) {
+            if (operation->fd >= 0) close(operation->fd);
+
+            _InternalCompleteFile(std::move(operation->op), error);
+            delete operation;
+
+            lock.lock();
+            in_flight--;
+            lock.unlock();
+
+            room.notify_all();
+        }
+
+        /// @brief Handles one completion. Short transfers are continued
+        void Complete(Operation* operation, int result) {
+            auto& op = *operation->op;
+
+            if (result == -EINTR || result == -EAGAIN) result = 0;
+            else if (result < 0) return Finish(operation, -result);
+            else if (result == 0) {
+                // A read stops at the end of the file. A write that moves
+                // nothing would never finish
+                return Finish(operation, op.kind == _InternalFileOperation::Kind::Read ? 0 : EIO);
+            }
+
+            op.done += static_cast<size_t>(result);
+
+            if (op.done == op.size) return Finish(operation, 0);
+
+            lock.lock();
+            auto error = Queue(operation);
+            lock.unlock();
+
+            if (error) Finish(operation, error);
+        }
+
+        void Reap() {
+            while (true) {
+                auto head = *cq_head;
+                auto tail = std::atomic_ref<unsigned>(*cq_tail).load(std::memory_order_acquire);
+
+                if (head == tail) {
+                    Enter(ring, 0, 1, IORING_ENTER_GETEVENTS);
+                    continue;
+                }
+
+                auto cqe = cqes[head & cq_mask];
+                std::atomic_ref<unsigned>(*cq_head).store(head + 1, std::memory_order_release);
+
+                if (cqe.user_data == stop_token) return;
+
+                Complete(reinterpret_cast<Operation*>(cqe.user_data), cqe.res);
+            }
+        }
+
+        /// @brief Opens the file and works out the size of a read
+        /// @return 0, or the errno code
+        int Open(Operation* operation) {
+            auto& op = *operation->op;
+
+            if (op.kind == _InternalFileOperation::Kind::Write) {
+                operation->fd = open(op.path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (op.truncate ? O_TRUNC : 0), 0644);
+                if (operation->fd < 0) return errno;
+
+                op.size = op.data.size();
+                return 0;
+            }
+
+            operation->fd = open(op.path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (operation->fd < 0) return errno;
+
+            if (op.size == FileRead::whole_file) {
+                struct stat info;
+                if (fstat(operation->fd, &info) != 0) return errno;
+
+                auto end = static_cast<uint64_t>(info.st_size);
+                op.size = end > op.offset ? static_cast<size_t>(end - op.offset) : 0;
+            }
+
+            op.data.resize(op.size);
+            return 0;
+        }
+
+    public:
+        /// @brief Sets up the ring. Check IsValid afterwards, io_uring can be
+        /// missing or blocked
+        explicit _InternalUringFileBackend(unsigned entries) {
+            io_uring_params params;
+            std::memset(&params, 0, sizeof(params));
+
+            ring = Setup(entries, &params);
+            if (ring < 0) return;
+
+            sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+            bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+            if (single_mmap) sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+
+            sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+            if (sq_ring == MAP_FAILED) return;
+
+            if (single_mmap) cq_ring = sq_ring;
+            else {
+                cq_ring = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+                if (cq_ring == MAP_FAILED) return;
+            }
+
+            sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+            sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES));
+            if (sqes == MAP_FAILED) return;
+
+            auto sq = static_cast<char*>(sq_ring);
+            sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+            sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+            sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+            sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+            auto cq = static_cast<char*>(cq_ring);
+            cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+            cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+            cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+            cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+            // Leave room for the stop no-op
+            max_in_flight = params.cq_entries - 1;
+
+            reaper = std::thread([this]() { Reap(); });
+        }
+
+        ~_InternalUringFileBackend() {
+            if (reaper.joinable()) {
+                std::unique_lock guard(lock);
+
+                // The kernel still writes into the buffers of running
+                // transfers, so let them finish first
+                room.wait(guard, [&]() { return in_flight == 0; });
+
+                auto error = Push(IORING_OP_NOP, -1, nullptr, 0, stop_token);
+
+                guard.unlock();
+
+                if (error) {
+                    // Nothing is left to complete, so the reaper stays blocked
+                    // in the kernel. Leak it and the rings rather than hang
+                    engine::Error("Could not stop the io_uring reaper: {}", std::strerror(error));
+
+                    reaper.detach();
+                    return;
+                }
+
+                reaper.join();
+            }
+
+            if (sqes != MAP_FAILED) munmap(sqes, sqes_size);
+            if (cq_ring != MAP_FAILED && cq_ring != sq_ring) munmap(cq_ring, cq_ring_size);
+            if (sq_ring != MAP_FAILED) munmap(sq_ring, sq_ring_size);
+
+            if (ring >= 0) close(ring);
+        }
+
+        inline bool IsValid() const { return reaper.joinable(); }
+
+        void Submit(std::unique_ptr<_InternalFileOperation> op) override {
+            auto operation = new Operation;
+            operation->op = std::move(op);
+
+            if (auto error = Open(operation)) {
+                if (operation->fd >= 0) close(operation->fd);
+
+                _InternalCompleteFile(std::move(operation->op), error);
+                delete operation;
+                return;
+            }
+
+            if (operation->op->size == 0) {
+                close(operation->fd);
+
+                _InternalCompleteFile(std::move(operation->op), 0);
+                delete operation;
+                return;
+            }
+
+            std::unique_lock guard(lock);
+
+            room.wait(guard, [&]() { return in_flight < max_in_flight; });
+
+            in_flight++;
+            auto error = Queue(operation);
+
+            guard.unlock();
+
+            if (error) Finish(operation, error);
+        }
+    };
+
+#endif
+
+    std::unique_ptr<_InternalFileBackend> _InternalFileBackend::Create() {
+#ifdef CROW_IO_URING
+        auto uring = std::make_unique<_InternalUringFileBackend>(256);
+        if (uring->IsValid()) return uring;
+#endif
+
+        engine::Info("File I/O uses a thread pool");
+
+        return std::make_unique<_InternalThreadFileBackend>(4);
+    }
+
+}
\ No newline at end of file
@@ -0,0 +1,63 @@
+#ifndef CROW_FILE_BACKEND_HPP
+#define CROW_FILE_BACKEND_HPP
+
+#include <crow/File.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace crow {
+
+    /// @brief A file request while it is being worked on
+    struct _InternalFileOperation {
+        enum class Kind { Read, Write };
+
+        Kind kind;
+
+        std::string path;
+
+        uint64_t offset = 0;
+
+        /// @brief The bytes to transfer, FileRead::whole_file until a read
+        /// knows the size of its file
+        size_t size = 0;
+
+        bool truncate = false;
+
+        std::vector<std::byte> data;
+
+        /// @brief The bytes transferred so far
+        size_t done = 0;
+
+        /// @brief Keeps the operation counted as in flight on the scheduler
+        /// that submitted it. Declared before reply, so a broken promise is
+        /// still counted
+        _InternalExternalWork work;
+
+        Promise<FileResult> reply;
+    };
+
+    /// @brief Sends the result of op to whoever asked
+    /// @param error 0, or the errno code the operation failed with
+    void _InternalCompleteFile(std::unique_ptr<_InternalFileOperation> op, int error);
+
+    /// @brief Does the I/O of the FileSystem on threads of its own
+    class _InternalFileBackend {
+    public:
+        virtual ~_InternalFileBackend() = default;
+
+        /// @brief Starts op. It is completed later on another thread.
+        /// Operations still running finish before the backend is destroyed
+        virtual void Submit(std::unique_ptr<_InternalFileOperation> op) = 0;
+
+        /// @brief Creates the io_uring backend if the system has it, and the
+        /// thread pool backend otherwise
+        static std::unique_ptr<_InternalFileBackend> Create();
+    };
+
+}
+
+#endif
\ No newline at end of file
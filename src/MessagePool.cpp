@@ -0,0 +1,7 @@
+#include <crow/MessagePool.hpp>
+
+namespace crow {
+
+    MessagePoolStats message_pool_stats;
+
+}
\ No newline at end of file
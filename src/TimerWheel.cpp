@@ -0,0 +1,193 @@
+#include "TimerWheel.hpp"
+
+#include <algorithm>
+#include <bit>
+
+namespace crow {
+
+    _InternalTimerWheel::~_InternalTimerWheel() {
+        for (auto& handle : handles) {
+            if (handle.timer) handle.timer->destroy(handle.timer);
+        }
+    }
+
+    void _InternalTimerWheel::Link(_InternalTimer* timer) {
+        auto delta = timer->due - current;
+
+        size_t level = 0;
+        while (level + 1 < level_count && delta >= (uint64_t(1) << (slot_bits * (level + 1)))) level++;
+
+        // Past the top level the timer waits in the furthest slot and is
+        // placed again when that slot cascades
+        auto due = timer->due;
+        auto span = uint64_t(1) << (slot_bits * level_count);
+        if (delta >= span) due = current + span - 1;
+
+        size_t slot = (due >> (slot_bits * level)) & (slot_count - 1);
+
+        timer->slot = static_cast<uint32_t>(level * slot_count + slot);
+
+        auto& head = slots[level][slot].head;
+        timer->prev = nullptr;
+        timer->next = head;
+        if (head) head->prev = timer;
+        head = timer;
+
+        occupied[level] |= uint64_t(1) << slot;
+    }
+
+    void _InternalTimerWheel::Unlink(_InternalTimer* timer) {
+        auto level = timer->slot / slot_count;
+        auto slot = timer->slot % slot_count;
+
+        if (timer->prev) timer->prev->next = timer->next;
+        else slots[level][slot].head = timer->next;
+
+        if (timer->next) timer->next->prev = timer->prev;
+
+        if (!slots[level][slot].head) occupied[level] &= ~(uint64_t(1) << slot);
+    }
+
+    void _InternalTimerWheel::Cascade(size_t level, size_t slot) {
+        auto timer = slots[level][slot].head;
+
+        slots[level][slot].head = nullptr;
+        occupied[level] &= ~(uint64_t(1) << slot);
+
+        while (timer) {
+            auto next = timer->next;
+            Link(timer);
+            timer = next;
+        }
+    }
+
+    TimerHandle _InternalTimerWheel::Insert(_InternalTimer* timer) {
+        uint32_t index;
+
+        if (!free_handles.empty()) {
+            index = free_handles.back();
+            free_handles.pop_back();
+        }
+        else {
+            index = static_cast<uint32_t>(handles.size());
+            handles.emplace_back();
+        }
+
+        handles[index].timer = timer;
+        timer->handle = index;
+
+        Link(timer);
+        count++;
+
+        return TimerHandle{index, handles[index].generation};
+    }
+
+    bool _InternalTimerWheel::Cancel(TimerHandle handle) {
+        if (handle.index >= handles.size()) return false;
+
+        auto& entry = handles[handle.index];
+        if (!entry.timer || entry.generation != handle.generation) return false;
+
+        auto timer = entry.timer;
+
+        count--;
+
+        entry.timer = nullptr;
+        entry.generation++;
+        free_handles.push_back(handle.index);
+
+        // Rearm sees the handle is gone and destroys it
+        if (timer->slot == firing) return true;
+
+        Unlink(timer);
+        timer->destroy(timer);
+
+        return true;
+    }
+
+    _InternalTimer* _InternalTimerWheel::Advance(uint64_t tick) {
+        _InternalTimer* first = nullptr;
+        _InternalTimer* last = nullptr;
+
+        while (current < tick) {
+            // Jump over ticks where nothing happens. NextDue stops at every
+            // cascade that has timers, so no slot is skipped
+            auto next = NextDue();
+            if (next > tick) {
+                current = tick;
+                break;
+            }
+
+            current = next;
+
+            for (size_t level = level_count - 1; level > 0; level--) {
+                auto mask = (uint64_t(1) << (slot_bits * level)) - 1;
+                if ((current & mask) == 0) Cascade(level, (current >> (slot_bits * level)) & (slot_count - 1));
+            }
+
+            auto slot = current & (slot_count - 1);
+            auto timer = slots[0][slot].head;
+
+            slots[0][slot].head = nullptr;
+            occupied[0] &= ~(uint64_t(1) << slot);
+
+            while (timer) {
+                auto next_timer = timer->next;
+
+                if (timer->period != 0) timer->slot = firing;
+                else {
+                    count--;
+
+                    auto& entry = handles[timer->handle];
+                    entry.timer = nullptr;
+                    entry.generation++;
+                    free_handles.push_back(timer->handle);
+                }
+
+                timer->next = nullptr;
+
+                if (last) last->next = timer;
+                else first = timer;
+
+                last = timer;
+
+                timer = next_timer;
+            }
+        }
+
+        return first;
+    }
+
+    void _InternalTimerWheel::Rearm(_InternalTimer* timer) {
+        if (handles[timer->handle].timer != timer) {
+            timer->destroy(timer);
+            return;
+        }
+
+        // Keep the period's phase, but skip periods that were missed instead
+        // of firing a burst to catch up
+        auto missed = (current - timer->due) / timer->period;
+        timer->due += timer->period * (missed + 1);
+
+        Link(timer);
+    }
+
+    uint64_t _InternalTimerWheel::NextDue() const {
+        if (count == 0) return no_timer;
+
+        auto start = (current + 1) & (slot_count - 1);
+        auto ahead = std::rotr(occupied[0], static_cast<int>(start));
+
+        auto next_cascade = ((current >> slot_bits) + 1) << slot_bits;
+
+        bool cascades = false;
+        for (size_t level = 1; level < level_count; level++) cascades = cascades || occupied[level] != 0;
+
+        uint64_t next = no_timer;
+        if (ahead != 0) next = current + 1 + std::countr_zero(ahead);
+        if (cascades) next = std::min(next, next_cascade);
+
+        return next;
+    }
+
+}
\ No newline at end of file
@@ -0,0 +1,95 @@
+#ifndef CROW_TIMER_WHEEL_HPP
+#define CROW_TIMER_WHEEL_HPP
+
+#include <crow/Actor.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace crow {
+
+    /// @brief A hierarchical timing wheel with 1 ms ticks. Each of the levels
+    /// has 64 slots and covers 64 times the span of the one below, so timers
+    /// up to about 4.6 hours away are placed directly and later ones are
+    /// cascaded down as time passes. Inserting and cancelling are O(1). This
+    /// is not thread safe, the ActorScheduler locks around it
+    class _InternalTimerWheel {
+    public:
+        static constexpr uint64_t no_timer = static_cast<uint64_t>(-1);
+
+    private:
+        /// @brief The slot of a periodic timer that is being fired
+        static constexpr uint32_t firing = static_cast<uint32_t>(-1);
+
+        static constexpr size_t slot_bits = 6;
+        static constexpr size_t slot_count = 1 << slot_bits;
+        static constexpr size_t level_count = 4;
+
+        struct Slot {
+            _InternalTimer* head = nullptr;
+        };
+
+        Slot slots[level_count][slot_count];
+
+        /// @brief One bit per slot that has timers, to find the next one
+        /// without scanning
+        uint64_t occupied[level_count] = {};
+
+        /// @brief The last tick that was expired
+        uint64_t current = 0;
+
+        size_t count = 0;
+
+        struct Handle {
+            _InternalTimer* timer = nullptr;
+            uint32_t generation = 0;
+        };
+
+        /// @brief Maps TimerHandles to timers. Freed entries bump their
+        /// generation so stale handles cannot cancel a new timer
+        std::vector<Handle> handles;
+        std::vector<uint32_t> free_handles;
+
+        void Link(_InternalTimer* timer);
+
+        void Unlink(_InternalTimer* timer);
+
+        /// @brief Moves every timer of a slot to the levels below
+        void Cascade(size_t level, size_t slot);
+
+    public:
+        ~_InternalTimerWheel();
+
+        inline uint64_t GetCurrent() const { return current; }
+
+        inline bool Empty() const { return count == 0; }
+
+        /// @brief Adds a timer. timer->due must be after GetCurrent()
+        TimerHandle Insert(_InternalTimer* timer);
+
+        /// @brief Removes and destroys a timer. A periodic timer that is
+        /// being fired is destroyed by Rearm instead
+        /// @return \c false if the timer already fired or was cancelled
+        bool Cancel(TimerHandle handle);
+
+        /// @brief Takes every timer due up to and including tick, so the
+        /// caller can fire them without holding its lock. One-shot timers
+        /// leave the wheel and the caller destroys them after firing.
+        /// Periodic timers stay cancellable and go back with Rearm
+        /// @return The timers in the order they were due, linked by next
+        _InternalTimer* Advance(uint64_t tick);
+
+        /// @brief Puts a periodic timer taken by Advance back, at its next
+        /// due tick after the current one, or destroys it if it was
+        /// cancelled meanwhile
+        void Rearm(_InternalTimer* timer);
+
+        /// @brief The earliest tick Advance has to be called at, which may be
+        /// early when timers still need cascading
+        /// @return The tick, or no_timer if there are no timers
+        uint64_t NextDue() const;
+    };
+
+}
+
+#endif
\ No newline at end of file
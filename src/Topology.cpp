@@ -0,0 +1,112 @@
+#include "Topology.hpp"
+
+#include <algorithm>
+#include <thread>
+
+#ifdef WINDOWS
+#include <Windows.h>
+#else
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace crow {
+
+#ifndef WINDOWS
+    /// @brief Parses a sysfs cpu list, such as "0-3,8-11"
+    static std::vector<size_t> ParseCpuList(const std::string& list) {
+        std::vector<size_t> cpus;
+
+        size_t pos = 0;
+        while (pos < list.size()) {
+            auto end = list.find(',', pos);
+            if (end == std::string::npos) end = list.size();
+
+            auto range = list.substr(pos, end - pos);
+            auto dash = range.find('-');
+
+            try {
+                size_t first = std::stoul(range.substr(0, dash));
+                size_t last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+
+                for (auto cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+            }
+            catch (...) {}
+
+            pos = end + 1;
+        }
+
+        return cpus;
+    }
+#endif
+
+    std::vector<_InternalCore> _InternalGetCores() {
+        std::vector<_InternalCore> cores;
+
+#ifdef WINDOWS
+        // Affinity masks only cover one processor group
+        auto count = std::min<size_t>(std::thread::hardware_concurrency(), sizeof(DWORD_PTR) * 8);
+
+        for (size_t cpu = 0; cpu < count; cpu++) cores.push_back({cpu, 0});
+#else
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+            for (size_t cpu = 0; cpu < std::thread::hardware_concurrency() && cpu < CPU_SETSIZE; cpu++)
+                CPU_SET(cpu, &allowed);
+        }
+
+        std::vector<size_t> nodes;
+
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator("/sys/devices/system/node", error)) {
+            auto name = entry.path().filename().string();
+
+            if (name.rfind("node", 0) != 0 || name.size() == 4) continue;
+            if (!std::all_of(name.begin() + 4, name.end(), [](char c) { return c >= '0' && c <= '9'; })) continue;
+
+            nodes.push_back(std::stoul(name.substr(4)));
+        }
+
+        std::sort(nodes.begin(), nodes.end());
+
+        for (auto node : nodes) {
+            std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+
+            std::string list;
+            std::getline(file, list);
+
+            for (auto cpu : ParseCpuList(list)) {
+                if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) cores.push_back({cpu, node});
+            }
+        }
+
+        // No NUMA information, so treat the machine as one node
+        if (cores.empty()) {
+            for (size_t cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &allowed)) cores.push_back({cpu, 0});
+            }
+        }
+#endif
+
+        return cores;
+    }
+
+    bool _InternalPinCurrentThread(size_t cpu) {
+#ifdef WINDOWS
+        return SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1) << cpu) != 0;
+#else
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#endif
+    }
+
+}
\ No newline at end of file
@@ -0,0 +1,29 @@
+#ifndef CROW_TOPOLOGY_HPP
+#define CROW_TOPOLOGY_HPP
+
+#include <cstddef>
+#include <vector>
+
+namespace crow {
+
+    /// @brief A core the process may run on
+    struct _InternalCore {
+        /// @brief The OS id of the core
+        size_t cpu;
+
+        /// @brief The NUMA node the core belongs to
+        size_t node;
+    };
+
+    /// @brief Returns the cores this process may run on, grouped by NUMA node
+    /// @return The cores, every core of a node next to each other
+    std::vector<_InternalCore> _InternalGetCores();
+
+    /// @brief Pins the calling thread to one core
+    /// @param cpu The OS id of the core
+    /// @return \c true if the thread was pinned, \c false otherwise
+    bool _InternalPinCurrentThread(size_t cpu);
+
+}
+
+#endif
\ No newline at end of file
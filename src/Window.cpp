@@ -124,46 +124,62 @@ namespace crow {
         window = _InternalWindow::CreateWindow();
     }
 
-    void Window::HandleMessage(std::unique_ptr<WindowMessageBase>&& msg) {
-        if (auto get_res = dynamic_cast<WindowGetResolution*>(msg.get())) {
-            get_res->callback(window->GetResolution());
-        }
-        else if (auto get_full_res = dynamic_cast<WindowGetFullscreenResolution*>(msg.get())) {
-            get_full_res->callback(window->GetFullscreenResolution());
-        }
-        else if (auto set_res = dynamic_cast<WindowSetResolution*>(msg.get())) {
-            window->SetResolution(set_res->resolution);
-        }
-        else if (auto get_full = dynamic_cast<WindowGetFullscreen*>(msg.get())) {
-            get_full->callback(window->IsFullscreen());
-        }
-        else if (auto set_full = dynamic_cast<WindowSetFullscreen*>(msg.get())) {
-            window->SetFullscreen(set_full->fullscreen);
-        }
-        else if (auto get_title = dynamic_cast<WindowGetTitle*>(msg.get())) {
-            get_title->callback(window->GetTitle());
-        }
-        else if (auto set_title = dynamic_cast<WindowSetTitle*>(msg.get())) {
-            window->SetTitle(set_title->title);
-        }
-        else if (dynamic_cast<WindowCenter*>(msg.get())) {
-            window->Center();
-        }
-        else if (dynamic_cast<WindowUpdate*>(msg.get())) {
-            window->Update();
-        }
-        else if (dynamic_cast<WindowCreate*>(msg.get())) {
-            window->Create();
-        }
-        else if (auto should_close = dynamic_cast<WindowShouldClose*>(msg.get())) {
-            should_close->callback(window->ShouldClose());
-        }
-        else if (dynamic_cast<WindowClose*>(msg.get())) {
-            window = nullptr;
-        }
-        else {
-            engine::Error("Unhandled window message");
-        }
+    /// @brief Answers a query through its callback and its promise, whichever
+    /// the sender used
+    template <typename Message, typename Value>
+    static void Reply(Message& msg, const Value& value) {
+        if (msg.callback) msg.callback(value);
+        msg.reply.Set(value);
+    }
+
+    void Window::HandleMessage(WindowGetResolution&& msg) {
+        Reply(msg, window->GetResolution());
+    }
+
+    void Window::HandleMessage(WindowGetFullscreenResolution&& msg) {
+        Reply(msg, window->GetFullscreenResolution());
+    }
+
+    void Window::HandleMessage(WindowSetResolution&& msg) {
+        window->SetResolution(msg.resolution);
+
+        actor_scheduler->Publish<WindowResized>(WindowResized{window->GetResolution()});
+    }
+
+    void Window::HandleMessage(WindowGetFullscreen&& msg) {
+        Reply(msg, window->IsFullscreen());
+    }
+
+    void Window::HandleMessage(WindowSetFullscreen&& msg) {
+        window->SetFullscreen(msg.fullscreen);
+    }
+
+    void Window::HandleMessage(WindowGetTitle&& msg) {
+        Reply(msg, window->GetTitle());
+    }
+
+    void Window::HandleMessage(WindowSetTitle&& msg) {
+        window->SetTitle(msg.title);
+    }
+
+    void Window::HandleMessage(WindowCenter&&) {
+        window->Center();
+    }
+
+    void Window::HandleMessage(WindowUpdate&&) {
+        window->Update();
+    }
+
+    void Window::HandleMessage(WindowCreate&&) {
+        window->Create();
+    }
+
+    void Window::HandleMessage(WindowShouldClose&& msg) {
+        Reply(msg, window->ShouldClose());
+    }
+
+    void Window::HandleMessage(WindowClose&&) {
+        window = nullptr;
     }
 
 }
\ No newline at end of file